@@ -75,13 +75,31 @@ void testRNN(void) {
   info.output_size = 1;
   info.hidden_layers_size = 1;
   info.neurons_per[0] = 20;
-  info.bptt_depth = DEPTH;
+  info.bptt_depth = 2 * DEPTH;
   info.learning_rate = 0.001;
   info.beta = 0.9;
+  info.bptt_stride = DEPTH;
+  info.clip_norm = 5.0;
+  info.mode = RNN_seq_to_seq;
 
   RNN_neural_network_t *rnn = malloc(sizeof *rnn);
   RNN_init_neural_network(rnn, &info);
 
+#define VALIDATION  200
+  static double val_data[VALIDATION][LENGTH];
+  static double val_targ[VALIDATION][LENGTH];
+  RNN_eval_sequence_t val[VALIDATION];
+  for (int i = 0; i < VALIDATION; i++) {
+    for (int j = 0; j < LENGTH; j++)
+      val_data[i][j] = NN_random(2.0, -1.0);
+    for (int j = 0; j < LENGTH; j++)
+      val_targ[i][j] = j < DEPTH ? 0.0 : val_data[i][j - DEPTH];
+    val[i].inputs = val_data[i];
+    val[i].targets = val_targ[i];
+    val[i].length = LENGTH;
+    val[i].skip = DEPTH;
+  }
+
   for (int e = 0; e < EPOCHS; ++e) {
     double mse = 0.0;
     int count = 0;
@@ -96,7 +114,8 @@ void testRNN(void) {
         count++;
       }
     }
-    printf("epoch %-3d | loss %.6f\n", e + 1, mse / (double) count);
+    double val_mse = RNN_evaluate_sequences(rnn, val, VALIDATION, 4);
+    printf("epoch %-3d | loss %.6f | val %.6f\n", e + 1, mse / (double) count, val_mse);
   }
 
   printf("TEST:\n");
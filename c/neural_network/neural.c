@@ -3,8 +3,10 @@
 #include <string.h>
 #include <math.h>
 #include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-#include "mtwister.h"
 #include "neural.h"
 
 #define CLAMP( v, l, h ){ v = v < (l) ? (l) : v > (h) ? (h) : v; }
@@ -12,20 +14,125 @@
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-function"
 
-static MTRand mt_rand;
-int mt_inited = 0;
+// Philox4x32-10: ten multiply / xor rounds turn (block, stream) under the seed into 128 random bits, two draws
+#define PHILOX_M0  0xD2511F53u
+#define PHILOX_M1  0xCD9E8D57u
+#define PHILOX_W0  0x9E3779B9u
+#define PHILOX_W1  0xBB67AE85u
+
+static NN_rng_t nn_rng = { 123, 0, 0 };  // NN_random's stream
+
+static void philox(uint64_t key, uint64_t stream, uint64_t block, uint32_t out[4]) {
+  uint32_t c0 = (uint32_t) block, c1 = (uint32_t) (block >> 32);
+  uint32_t c2 = (uint32_t) stream, c3 = (uint32_t) (stream >> 32);
+  uint32_t k0 = (uint32_t) key, k1 = (uint32_t) (key >> 32);
+  for (int r = 0; r < 10; r++) {
+    uint64_t p0 = (uint64_t) PHILOX_M0 * c0;
+    uint64_t p1 = (uint64_t) PHILOX_M1 * c2;
+    uint32_t n0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+    uint32_t n2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+    c1 = (uint32_t) p1;
+    c3 = (uint32_t) p0;
+    c0 = n0;
+    c2 = n2;
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+// top 53 bits of a 64-bit half, [0, 1)
+static double philox_double(uint32_t lo, uint32_t hi) {
+  return (double) ((((uint64_t) hi << 32) | lo) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// draw i is half i & 1 of block i >> 1
+static double rng_draw(uint64_t key, uint64_t stream, uint64_t i) {
+  uint32_t x[4];
+  philox(key, stream, i >> 1, x);
+  return (i & 1) ? philox_double(x[2], x[3]) : philox_double(x[0], x[1]);
+}
+
+#if defined(__SSE2__)
+// 32x32 -> 64 multiply of four lanes by one constant, split into the high and low words
+static void mulhilo4(__m128i a, __m128i m, __m128i *hi, __m128i *lo) {
+  __m128i even = _mm_shuffle_epi32(_mm_mul_epu32(a, m), _MM_SHUFFLE(3, 1, 2, 0));
+  __m128i odd = _mm_shuffle_epi32(_mm_mul_epu32(_mm_srli_epi64(a, 32), m), _MM_SHUFFLE(3, 1, 2, 0));
+  *lo = _mm_unpacklo_epi32(even, odd);
+  *hi = _mm_unpackhi_epi32(even, odd);
+}
+
+// four consecutive blocks, one per lane, eight draws
+static void philox4(uint64_t key, uint64_t stream, uint64_t block, double *values) {
+  __m128i c0 = _mm_setr_epi32((int) block, (int) (block + 1), (int) (block + 2), (int) (block + 3));
+  __m128i c1 = _mm_setr_epi32((int) (block >> 32), (int) ((block + 1) >> 32), (int) ((block + 2) >> 32), (int) ((block + 3) >> 32));
+  __m128i c2 = _mm_set1_epi32((int) stream), c3 = _mm_set1_epi32((int) (stream >> 32));
+  __m128i k0 = _mm_set1_epi32((int) key), k1 = _mm_set1_epi32((int) (key >> 32));
+  __m128i m0 = _mm_set1_epi32((int) PHILOX_M0), m1 = _mm_set1_epi32((int) PHILOX_M1);
+  __m128i w0 = _mm_set1_epi32((int) PHILOX_W0), w1 = _mm_set1_epi32((int) PHILOX_W1);
+  for (int r = 0; r < 10; r++) {
+    __m128i hi0, lo0, hi1, lo1;
+    mulhilo4(c0, m0, &hi0, &lo0);
+    mulhilo4(c2, m1, &hi1, &lo1);
+    c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), k0);
+    c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), k1);
+    c1 = lo1;
+    c3 = lo0;
+    k0 = _mm_add_epi32(k0, w0);
+    k1 = _mm_add_epi32(k1, w1);
+  }
+  uint32_t x[4][4];
+  _mm_storeu_si128((__m128i*) x[0], c0);
+  _mm_storeu_si128((__m128i*) x[1], c1);
+  _mm_storeu_si128((__m128i*) x[2], c2);
+  _mm_storeu_si128((__m128i*) x[3], c3);
+  for (int b = 0; b < 4; b++) {
+    values[2 * b] = philox_double(x[0][b], x[1][b]);
+    values[2 * b + 1] = philox_double(x[2][b], x[3][b]);
+  }
+}
+#endif
 
 void NN_seed_random(unsigned long seed) {
-  mt_rand = seedRand(seed);
-  mt_inited = 1;
+  nn_rng.key = seed;
+  nn_rng.stream = 0;
+  nn_rng.counter = 0;
 }
 
 double NN_random(double scale, double offset) {
-  if (!mt_inited) {
-    mt_rand = seedRand(123);
-    mt_inited = 1;
+  return NN_rng_random(&nn_rng, scale, offset);
+}
+
+void NN_random_fill(double *values, int count, double scale, double offset) {
+  NN_rng_fill(&nn_rng, values, count, scale, offset);
+}
+
+NN_rng_t NN_rng_stream(unsigned long long stream) {
+  NN_rng_t rng = { nn_rng.key, stream, 0 };
+  return rng;
+}
+
+double NN_rng_random(NN_rng_t *rng, double scale, double offset) {
+  return rng_draw(rng->key, rng->stream, rng->counter++) * scale + offset;
+}
+
+void NN_rng_fill(NN_rng_t *rng, double *values, int count, double scale, double offset) {
+  int i = 0;
+  if (count > 0 && (rng->counter & 1))
+    values[i++] = NN_rng_random(rng, scale, offset);  // finish the half used block
+#if defined(__SSE2__)
+  for (; i + 8 <= count; i += 8) {
+    philox4(rng->key, rng->stream, rng->counter >> 1, &values[i]);
+    for (int j = 0; j < 8; j++)
+      values[i + j] = values[i + j] * scale + offset;
+    rng->counter += 8;
   }
-  return genRand(&mt_rand) * scale + offset;
+#endif
+  for (; i < count; i++)
+    values[i] = NN_rng_random(rng, scale, offset);
 }
 
 double sigmoid_act(double x) {
@@ -90,8 +197,7 @@ static double act_deriv(double x, NN_activation_type_t type) {
 }
 
 static void init_neuron(NN_neuron_t *neuron, int n) {
-  for (int i = 0; i < n; i++)
-    neuron->weights[i] = NN_random(2.0, -1.0);
+  NN_random_fill(neuron->weights, n, 2.0, -1.0);
   neuron->bias = 0.0;
 }
 
@@ -178,24 +284,49 @@ void NN_forward_propagate(NN_neural_network_t *nn) {
     nn->prediction[i] = nn->output_layer.neurons[i].value;
 }
 
-// the effing meat and potatoes of this whol thing
-void NN_backward_propagate(NN_neural_network_t *nn) {
-  double learning_rate = nn->info.learning_rate;
-  double lambda = nn->info.l2_decay;
+// rows of a batched pass kept on the stack at once; each weight row is reused across the whole tile
+#define NN_BATCH_TILE 32
+
+static void neural_layer_propagate_batch(const NN_neural_layer_t *layer, int input_size, const double *in, double *out, int rows, int activate, NN_activation_type_t act_type) {
+  for (int i = 0; i < layer->size; i++) {
+    const NN_neuron_t *neuron = &layer->neurons[i];
+    for (int k = 0; k < rows; k++) {
+      const double *x = &in[k * NN_MAX_NEURONS];
+      double sum = neuron->bias;
+      for (int j = 0; j < input_size; j++)
+        sum += neuron->weights[j] * x[j];
+      out[k * NN_MAX_NEURONS + i] = activate ? act_func(sum, act_type) : sum;
+    }
+  }
+}
+
+void NN_forward_batch(const NN_neural_network_t *nn, const double *inputs, double *outputs, int count) {
+  double buffers[2][NN_BATCH_TILE * NN_MAX_NEURONS];
+  for (int base = 0; base < count; base += NN_BATCH_TILE) {
+    int rows = count - base < NN_BATCH_TILE ? count - base : NN_BATCH_TILE;
+    double *in = buffers[0];
+    double *out = buffers[1];
+    for (int k = 0; k < rows; k++)
+      memcpy(&in[k * NN_MAX_NEURONS], &inputs[(base + k) * nn->input_size], sizeof(double) * nn->input_size);
+    int input_size = nn->input_size;
+    for (int l = 0; l < nn->info.hidden_layers_size; l++) {
+      neural_layer_propagate_batch(&nn->hidden_layers[l], input_size, in, out, rows, 1, nn->info.activation);
+      input_size = nn->hidden_layers[l].size;
+      double *swap = in;
+      in = out;
+      out = swap;
+    }
+    neural_layer_propagate_batch(&nn->output_layer, input_size, in, out, rows, 0, nn->info.activation);
+    for (int k = 0; k < rows; k++)
+      memcpy(&outputs[(base + k) * nn->output_size], &out[k * NN_MAX_NEURONS], sizeof(double) * nn->output_size);
+  }
+}
 
+static void neural_compute_deltas(NN_neural_network_t *nn) {
   int output_size = nn->info.output_size;
-// calculate output layer errors and gradients
   NN_neural_layer_t *output_layer = &nn->output_layer;
   NN_neuron_t *output_neurons = output_layer->neurons;
 
-  /*
-   double mse = 0.0;
-   for (int i = 0; i < output_size; i++) {
-   double error = output_neurons[i].value - nn->target[i];
-   mse += error * error;
-   }
-   */
-
   // compute output layer error
   for (int i = 0; i < output_size; i++)
     output_neurons[i].delta = output_neurons[i].value - nn->target[i];
@@ -215,6 +346,27 @@ void NN_backward_propagate(NN_neural_network_t *nn) {
     }
     next_layer = curr_layer;
   }
+}
+
+// the effing meat and potatoes of this whol thing
+void NN_backward_propagate(NN_neural_network_t *nn) {
+  double learning_rate = nn->info.learning_rate;
+  double lambda = nn->info.l2_decay;
+
+  int output_size = nn->info.output_size;
+// calculate output layer errors and gradients
+  NN_neural_layer_t *output_layer = &nn->output_layer;
+  NN_neuron_t *output_neurons = output_layer->neurons;
+
+  /*
+   double mse = 0.0;
+   for (int i = 0; i < output_size; i++) {
+   double error = output_neurons[i].value - nn->target[i];
+   mse += error * error;
+   }
+   */
+
+  neural_compute_deltas(nn);
 
   // update output layer weights and biases
 
@@ -226,7 +378,6 @@ void NN_backward_propagate(NN_neural_network_t *nn) {
     output_neurons[i].bias -= learning_rate * output_neurons[i].delta;
   }
 
-  next_layer = output_layer;
   for (int l = nn->info.hidden_layers_size - 1; l >= 0; l--) {
     NN_neural_layer_t *curr_layer = &nn->hidden_layers[l];  //next_layer->feed
 
@@ -246,10 +397,92 @@ void NN_backward_propagate(NN_neural_network_t *nn) {
         }
       }
     }
-    next_layer = curr_layer;
   }
 }
 
+void NN_zero_gradients(NN_neural_network_t *nn) {
+  for (int l = 0; l <= nn->info.hidden_layers_size; l++) {
+    NN_neural_layer_t *layer = l < nn->info.hidden_layers_size ? &nn->hidden_layers[l] : &nn->output_layer;
+    int n = layer->type == NN_first ? nn->info.input_size : layer->feed->size;
+    for (int i = 0; i < layer->size; i++) {
+      NN_neuron_t *neuron = &layer->neurons[i];
+      neuron->grad_bias = 0.0;
+      for (int j = 0; j < n; j++)
+        neuron->grad_weights[j] = 0.0;
+    }
+  }
+}
+
+void NN_accumulate_gradients(NN_neural_network_t *nn) {
+  neural_compute_deltas(nn);
+  for (int l = 0; l <= nn->info.hidden_layers_size; l++) {
+    NN_neural_layer_t *layer = l < nn->info.hidden_layers_size ? &nn->hidden_layers[l] : &nn->output_layer;
+    double feed[NN_MAX_NEURONS];
+    int n = layer->type == NN_first ? nn->info.input_size : layer->feed->size;
+    for (int j = 0; j < n; j++)
+      feed[j] = layer->type == NN_first ? nn->input[j] : layer->feed->neurons[j].value;
+    for (int i = 0; i < layer->size; i++) {
+      NN_neuron_t *neuron = &layer->neurons[i];
+      double delta = neuron->delta;
+      neuron->grad_bias += delta;
+      for (int j = 0; j < n; j++)
+        neuron->grad_weights[j] += delta * feed[j];
+    }
+  }
+}
+
+// same update rule as NN_backward_propagate, with the mean gradient
+void NN_apply_gradients(NN_neural_network_t *nn, int count) {
+  if (count <= 0)
+    return;
+  NN_apply_scaled_gradients(nn, 1.0 / (double) count);
+}
+
+void NN_apply_scaled_gradients(NN_neural_network_t *nn, double scale) {
+  double learning_rate = nn->info.learning_rate;
+  double lambda = nn->info.l2_decay;
+  for (int l = 0; l <= nn->info.hidden_layers_size; l++) {
+    NN_neural_layer_t *layer = l < nn->info.hidden_layers_size ? &nn->hidden_layers[l] : &nn->output_layer;
+    double decay = layer->type == NN_output ? 0.0 : lambda;
+    int n = layer->type == NN_first ? nn->info.input_size : layer->feed->size;
+    for (int i = 0; i < layer->size; i++) {
+      NN_neuron_t *neuron = &layer->neurons[i];
+      neuron->bias -= learning_rate * scale * neuron->grad_bias;
+      for (int j = 0; j < n; j++)
+        neuron->weights[j] -= learning_rate * (scale * neuron->grad_weights[j] - decay * neuron->weights[j]);
+    }
+  }
+}
+
+void NN_copy_weights(NN_neural_network_t *dst, const NN_neural_network_t *src) {
+  for (int l = 0; l <= src->info.hidden_layers_size; l++) {
+    const NN_neural_layer_t *from = l < src->info.hidden_layers_size ? &src->hidden_layers[l] : &src->output_layer;
+    NN_neural_layer_t *to = l < src->info.hidden_layers_size ? &dst->hidden_layers[l] : &dst->output_layer;
+    int n = from->type == NN_first ? src->info.input_size : from->feed->size;
+    for (int i = 0; i < from->size; i++) {
+      to->neurons[i].bias = from->neurons[i].bias;
+      memcpy(to->neurons[i].weights, from->neurons[i].weights, sizeof(double) * n);
+    }
+  }
+}
+
+double NN_train_batch(NN_neural_network_t *nn, const double *inputs, const double *targets, int count) {
+  double mse = 0.0;
+  NN_zero_gradients(nn);
+  for (int k = 0; k < count; k++) {
+    memcpy(nn->input, &inputs[k * nn->info.input_size], sizeof(double) * nn->info.input_size);
+    memcpy(nn->target, &targets[k * nn->info.output_size], sizeof(double) * nn->info.output_size);
+    NN_forward_propagate(nn);
+    NN_accumulate_gradients(nn);
+    for (int j = 0; j < nn->output_size; j++) {
+      double delta = nn->prediction[j] - nn->target[j];
+      mse += delta * delta;
+    }
+  }
+  NN_apply_gradients(nn, count);
+  return count ? mse / (double) (count * nn->output_size) : 0.0;
+}
+
 double NN_train_neural_network(NN_neural_network_t *nn) {
   NN_forward_propagate(nn);
   NN_backward_propagate(nn);
@@ -7,7 +7,11 @@ extern "C" {
 #define NN_MAX_NEURONS 128
 #define NN_MAX_HIDDEN_LAYERS  8
 
-#define RNN_MAX_DEPTH	16
+typedef enum {
+  NN_first,
+  NN_hidden,
+  NN_output
+} NN_layer_type_t;
 
 typedef struct {
   double weights[NN_MAX_NEURONS];
@@ -15,38 +19,16 @@ typedef struct {
   double value;
   double value_pre;
   double delta;
+  double grad_weights[NN_MAX_NEURONS];  // mini-batch accumulators
+  double grad_bias;
 } NN_neuron_t;
 
-typedef struct {
-  double weights[NN_MAX_NEURONS];
-  double recurrent_weights[NN_MAX_NEURONS];
-  double bias;
-  double history[RNN_MAX_DEPTH];
-} RNN_neuron_t;
-
-typedef enum {
-  NN_first,
-  NN_hidden,
-  NN_output
-} NN_layer_type_t;
-
-typedef struct RNN_neural_layer_s {
-  int size;
-  NN_layer_type_t type;
-  RNN_neuron_t neurons[NN_MAX_NEURONS];
-  union {
-    struct RNN_neural_layer_s *feed;
-    const double *input;
-  };
-} RNN_neural_layer_t;
-
 typedef struct NN_neural_layer_s {
   int size;
   NN_layer_type_t type;
   NN_neuron_t neurons[NN_MAX_NEURONS];
   union {
     struct NN_neural_layer_s *feed;
-    struct RNN_neural_layer_s *recurrent_feed;
     const double *input;
   };
 } NN_neural_layer_t;
@@ -80,38 +62,35 @@ typedef struct {
 
 } NN_neural_network_t;
 
+// counter-based random streams (Philox4x32-10): a draw is a pure function of seed, stream and counter, so each
+// thread or agent can own a stream and runs reproduce for a seed however the threads are scheduled
 typedef struct {
-  double learning_rate;
-  double l2_decay;
-  int input_size;
-  int output_size;
-  int hidden_layers_size;
-  int bptt_depth;
-  int neurons_per[NN_MAX_HIDDEN_LAYERS];
-} RNN_info_t;
-
-typedef struct {
-  RNN_info_t info;
-  double input[NN_MAX_NEURONS];
-  RNN_neural_layer_t hidden_layers[NN_MAX_HIDDEN_LAYERS];
-  NN_neural_layer_t output_layer;
-  double target[NN_MAX_NEURONS];
-  double prediction[NN_MAX_NEURONS];
-  int t;
-} RNN_neural_network_t;
-
-void NN_seed_random(unsigned long seed);
-double NN_random(double scale, double offset);  // open range [offset, offset + scale)
+  unsigned long long key;  // seed
+  unsigned long long stream;
+  unsigned long long counter;  // draws taken
+} NN_rng_t;
+
+void NN_seed_random(unsigned long seed);  // restarts NN_random's stream, and seeds the streams NN_rng_stream hands out
+double NN_random(double scale, double offset);  // open range [offset, offset + scale), stream 0, not thread safe
+void NN_random_fill(double *values, int count, double scale, double offset);  // the next count NN_random draws at once
+NN_rng_t NN_rng_stream(unsigned long long stream);  // stream of the current seed, 0 is NN_random's own
+double NN_rng_random(NN_rng_t *rng, double scale, double offset);
+void NN_rng_fill(NN_rng_t *rng, double *values, int count, double scale, double offset);
 void NN_init_neural_network(NN_neural_network_t *nn, const NN_info_t *params);
 void NN_export_neural_network(NN_neural_network_t *nn, const char *filename);
 void NN_import_neural_network(NN_neural_network_t **nn, const char *filename);
 void NN_forward_propagate(NN_neural_network_t *nn);
 void NN_backward_propagate(NN_neural_network_t *nn);
+void NN_copy_weights(NN_neural_network_t *dst, const NN_neural_network_t *src);  // networks must share the same NN_info_t
+void NN_forward_batch(const NN_neural_network_t *nn, const double *inputs, double *outputs, int count);  // inference only, network state is untouched
 double NN_train_neural_network(NN_neural_network_t *nn);
 
-void RNN_init_neural_network(RNN_neural_network_t *rnn, const RNN_info_t *params);
-void RNN_forward_propagate(RNN_neural_network_t *nn);
-void RNN_backward_propagate(RNN_neural_network_t *nn);
+// mini-batch training: accumulate after each forward pass, then apply the averaged update once
+void NN_zero_gradients(NN_neural_network_t *nn);
+void NN_accumulate_gradients(NN_neural_network_t *nn);
+void NN_apply_gradients(NN_neural_network_t *nn, int count);
+void NN_apply_scaled_gradients(NN_neural_network_t *nn, double scale);  // the accumulated gradients times scale, any sign
+double NN_train_batch(NN_neural_network_t *nn, const double *inputs, const double *targets, int count);  // count rows of input_size / output_size
 
 #ifdef __cplusplus
 }
@@ -5,6 +5,7 @@ extern "C" {
 #endif
 
 #include "neural.h"
+#include "recurrent.h"
 
 /** Reinforcement Learning using SARSA **/
 
@@ -19,12 +20,13 @@ extern "C" {
 #endif
 
 typedef enum RL_type_e {
-	RL_qlearn, RL_sarsa,
+  RL_qlearn,
+  RL_sarsa,
 } RL_type_t;
 
 typedef struct RL_action_s {
-	int taken;
-	RL_bool exploratory;
+  int taken;
+  RL_bool exploratory;
 } RL_action_t;
 
 typedef void *RL_agent_t;
@@ -33,17 +35,69 @@ typedef void *RL_agent_state_t;
 typedef void (*RL_set_input_cb)(RL_agent_state_t, double*);
 typedef void (*RL_act_cb)(RL_agent_state_t, int);
 typedef double (*RL_reward_cb)(RL_agent_state_t);
+typedef void (*RL_act_batch_cb)(RL_agent_state_t*, const int*, int);
+typedef unsigned long long (*RL_hash_cb)(RL_agent_state_t);  // equal states must hash equal, distinct ones that collide share a row
 
 RL_agent_t RL_init(RL_type_t type /* RL type SARSA or Q-LEARN*/,
-		double alpha /*Bellman learning rate (0 to 1)*/,
-		double epsilon /*greedy exploration rate*/,
-		double gamma /*discount factor (0 to 1)*/, const NN_info_t *nn_info,
-		RL_set_input_cb set, RL_reward_cb reward, RL_act_cb act,
-		RL_agent_state_t state);
+                   double alpha /*Bellman learning rate (0 to 1)*/,
+                   double epsilon /*greedy exploration rate*/,
+                   double gamma /*discount factor (0 to 1)*/,
+                   const NN_info_t *nn_info, RL_set_input_cb set,
+                   RL_reward_cb reward, RL_act_cb act, RL_agent_state_t state);
 
+RL_agent_t RL_init_recurrent(RL_type_t type, double alpha, double epsilon,
+                             double gamma, const RNN_info_t *rnn_info,
+                             RL_set_input_cb set, RL_reward_cb reward,
+                             RL_act_cb act, RL_agent_state_t state);
+
+// the Q-network sees only the observation, not the action that led to it; call right after RL_init,
+// before any other RL_enable_* or stepping (the network is rebuilt at the narrower width); false when it came too late
+// or the agent has no network, the action inputs are then kept
+RL_bool RL_drop_action_inputs(RL_agent_t agent);
+// Q-table instead of a network for small discrete problems: rows keyed by hash(state), set is only called once per
+// new state to keep its observation (input_size values) for RL_switch_to_neural. RL_step, RL_play and export / import
+// work as for RL_init agents; replay, target networks, RL_step_vec and actors need a network
+RL_agent_t RL_init_tabular(RL_type_t type, double alpha, double epsilon, double gamma, int input_size,
+                           int action_count, RL_hash_cb hash, RL_set_input_cb set, RL_reward_cb reward,
+                           RL_act_cb act, RL_agent_state_t state);
+// replaces a tabular agent's table with a network trained on it for epochs passes over the visited states; nn_info
+// sizes must be the table's input_size and action_count, the network then sees only the observation
+RL_bool RL_switch_to_neural(RL_agent_t agent, const NN_info_t *nn_info, int epochs);
 void RL_term(RL_agent_t *agent_ptr);
-void RL_step(RL_agent_t agent); // executes one RL update step using the specified algorithm (SARSA or Q-Learning)
+void RL_step(RL_agent_t agent);  // executes one RL update step using the specified algorithm (SARSA or Q-Learning)
+void RL_step_recurrent(RL_agent_t agent);  // same update, but the Q-network sees the observation history (RL_init_recurrent agents only)
+// frozen target network for bootstrap values, synced every sync_interval learning updates;
+// double_q picks the next action with the online network and values it with the target (Q-learning only)
+void RL_enable_target_network(RL_agent_t agent, int sync_interval, RL_bool double_q);
+
+// building blocks for an engine that runs its own environment loop on an RL_init agent (gym.h), so it learns by
+// the same rule as RL_step_vec; such an agent may be created with null callbacks and is never stepped. Rows are
+// input_size wide, the action that led to the state first unless RL_drop_action_inputs
+RL_action_t RL_choose_action(RL_agent_t agent, const double *qs, RL_bool explore);  // epsilon-greedy, or greedy
+double RL_td_target(RL_agent_t agent, double reward, int action, const double *next_qs);  // SARSA or Q-learning
+void RL_value_batch(RL_agent_t agent, const double *inputs, double *qs, int count);  // action values of count rows
+// one mini-batch update: each row's taken action moves alpha of the way to its td target, from a fresh pass over
+// the rows; targets holds the td targets on entry and the td errors on return
+void RL_fit_batch(RL_agent_t agent, const double *inputs, const int *actions, double *targets, int count);
+
+// steps count environments that share the agent's network and callbacks, one batched forward pass for all of them;
+// act_batch may be null, then the per-state act callback is used
+void RL_step_vec(RL_agent_t agent, RL_agent_state_t *states, int count, RL_act_batch_cb act_batch);
+// actor-learner mode, needs RL_enable_replay: num_actors threads split the count states and act on a published
+// snapshot of the Q-network, a learner thread trains from the replay buffer and republishes every publish_interval
+// updates. Callbacks run on actor threads, each state only ever on its own actor. RL_step / RL_step_vec are no-ops
+// until RL_stop_actors, the states must outlive the threads. RL_false when a thread could not be started, nothing
+// is left running then.
+RL_bool RL_start_actors(RL_agent_t agent, RL_agent_state_t *states, int count, int num_actors, int publish_interval);
+long RL_stop_actors(RL_agent_t agent);  // returns the environment steps the actors took
+long RL_actor_steps(RL_agent_t agent);  // environment steps taken since RL_start_actors
 void RL_export_neural_network(RL_agent_t agent, const char *filename);
+RL_bool RL_import_neural_network(RL_agent_t agent, const char *filename);  // checkpoint must match the agent's input and output sizes
+void RL_play(RL_agent_t agent);  // greedy action from the current network, no exploration and no learning
+
+// experience replay: RL_step records transitions and trains on sampled mini-batches instead of online
+void RL_enable_replay(RL_agent_t agent, int capacity, int batch_size, RL_bool prioritized);
+int RL_learn(RL_agent_t agent);  // one mini-batch update, returns the number of transitions used
 
 #ifdef __cplusplus
 }
@@ -30,7 +30,14 @@ double reward_cb(RL_agent_state_t state) {
   return (s->position == 4) ? 1.0 : 0.0;
 }
 
-int main() {
+unsigned long long hash_cb(RL_agent_state_t state) {
+  grid_agent_state_t *s = (grid_agent_state_t*) state;
+  return (unsigned long long) s->position;
+}
+
+// run as "test tabular" for the Q-table backend, it hands over to a network at the end
+int main(int argc, char *argv[]) {
+  int tabular = argc > 1 && 0 == strcmp(argv[1], "tabular");
   grid_agent_state_t agent_state = { .position = 0, .steps = 0 };
 
   NN_info_t nn_info;
@@ -43,7 +50,10 @@ int main() {
   nn_info.neurons_per[0] = 8;
   NN_seed_random(42);  // Optional: set RNG seed for reproducibility
 
-  RL_agent_t agent = RL_init(RL_qlearn,
+  RL_agent_t agent = tabular ?
+      RL_init_tabular(RL_qlearn, 0.1, 0.2, 0.99, nn_info.input_size, nn_info.output_size,
+                      hash_cb, set_input_cb, reward_cb, act_cb, &agent_state) :
+      RL_init(RL_qlearn,
       0.1,             // alpha (learning rate)
       0.2,             // epsilon (exploration)
       0.99,            // gamma (discount factor)
@@ -63,6 +73,16 @@ int main() {
            (agent_state.position == 4) ? "yes!" : "no");
   }
 
+  if (tabular) {
+    RL_export_neural_network(agent, "table.txt");
+    RL_switch_to_neural(agent, &nn_info, 2000);
+    agent_state.position = 0;
+    agent_state.steps = 0;
+    while (agent_state.position != 4 && agent_state.steps < 20)
+      RL_play(agent);
+    printf("network trained on the table: reached %d in %2d steps\n", agent_state.position, agent_state.steps);
+  }
+
   RL_export_neural_network(agent, "nn.txt");
   RL_term(&agent);
   return 0;
@@ -12,6 +12,21 @@ struct Game {
 
   NN_neural_network_t *nn = nullptr;
   double learn = 0.003;
+  static constexpr double chaserSpeed = 0.005;
+
+  // training label: step along each axis towards the runner
+  static Vector2 chaseDirection(Vector2 c, Vector2 p) {
+    Vector2 d;
+    if (p.x < c.x)
+      d.x = -1.0;
+    if (p.x > c.x)
+      d.x = +1.0;
+    if (p.y < c.y)
+      d.y = -1.0;
+    if (p.y > c.y)
+      d.y = +1.0;
+    return d;
+  }
 
   void run(int xDir, int yDir, float speed) {
     runner = runner + speed * Vector2(xDir, yDir);
@@ -31,31 +46,18 @@ struct Game {
     info.l2_decay = 0.0001;
     NN_init_neural_network(nn, &info);
 
+    // one bulk draw, the same values in the same order as drawing each coordinate
+    std::vector<double> coords(256 * 4);
+    NN_random_fill(coords.data(), (int) coords.size(), 1, -0.5);
     for (int i = 0; i < 256; i++) {
-      Vector2 v;
-      v.x = NN_random(1, -0.5);
-      v.y = NN_random(1, -0.5);
-      trainingPts.push_back(v);
-      v.x = NN_random(1, -0.5);
-      v.y = NN_random(1, -0.5);
-      trainingPts2.push_back(v);
+      trainingPts.push_back(Vector2(coords[i * 4], coords[i * 4 + 1]));
+      trainingPts2.push_back(Vector2(coords[i * 4 + 2], coords[i * 4 + 3]));
     }
   }
 
   void trainChaser() {
     auto setup_target = [&]() {
-      Vector2 d;
-      Vector2 c(nn->input[0], nn->input[1]);
-      Vector2 p(nn->input[2], nn->input[3]);
-      if (p.x < c.x)
-        d.x = -1.0;
-      if (p.x > c.x)
-        d.x = +1.0;
-      if (p.y < c.y)
-        d.y = -1.0;
-      if (p.y > c.y)
-        d.y = +1.0;
-      return d;
+      return chaseDirection(Vector2(nn->input[0], nn->input[1]), Vector2(nn->input[2], nn->input[3]));
     };
 
     size_t epochs = 0;
@@ -104,7 +106,7 @@ struct Game {
     float x = nn->prediction[0];
     float y = nn->prediction[1];
 
-    chaser = chaser + Vector2(x, y) * 0.005;
+    chaser = chaser + Vector2(x, y) * chaserSpeed;
   }
 
   ~Game() {
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <thread>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+#include "game.h"
+
+// headless chase trainer and evaluator, writes nn.txt for the demo (main.cpp) to load
+// usage: train [epochs] [batch size] [threads] [eval runners]
+
+Game g;
+
+struct Dataset {
+  int count = 0;
+  std::vector<double> inputs;  // count x 4: chaser, runner
+  std::vector<double> targets;  // count x 2
+
+  // every ordered pair of training points, both ways round, like Game::trainChaser
+  void generate(const std::vector<Vector2> &pts, const std::vector<Vector2> &pts2, int threads) {
+    int n = (int) pts.size(), n2 = (int) pts2.size();
+    count = 2 * n * n2;
+    inputs.resize((size_t) count * 4);
+    targets.resize((size_t) count * 2);
+    auto work = [&](int begin, int end) {
+      for (int i = begin; i < end; i++)
+        for (int j = 0; j < n2; j++) {
+          size_t row = 2 * ((size_t) i * n2 + j);
+          set(row, pts[i], pts2[j]);
+          set(row + 1, pts2[j], pts[i]);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++)
+      pool.emplace_back(work, n * t / threads, n * (t + 1) / threads);
+    for (auto &th : pool)
+      th.join();
+  }
+
+  void set(size_t row, Vector2 c, Vector2 p) {
+    double *in = &inputs[row * 4];
+    in[0] = c.x;
+    in[1] = c.y;
+    in[2] = p.x;
+    in[3] = p.y;
+    Vector2 d = Game::chaseDirection(c, p);
+    targets[row * 2 + 0] = d.x;
+    targets[row * 2 + 1] = d.y;
+  }
+
+  // Fisher-Yates over whole rows, the buffers stay contiguous for the batch passes
+  void shuffle(std::mt19937 &rng) {
+    for (int i = count - 1; i > 0; i--) {
+      int j = std::uniform_int_distribution<int>(0, i)(rng);
+      std::swap_ranges(&inputs[(size_t) i * 4], &inputs[(size_t) i * 4 + 4], &inputs[(size_t) j * 4]);
+      std::swap_ranges(&targets[(size_t) i * 2], &targets[(size_t) i * 2 + 2], &targets[(size_t) j * 2]);
+    }
+  }
+};
+
+// chasers follow the network against randomly wandering runners, one batched forward pass per step
+struct Evaluation {
+  int caught = 0;
+  long catchSteps = 0;
+};
+
+Evaluation evaluate(const NN_neural_network_t *nn, int runners, int threads, int maxSteps = 2000, double radius = 0.02) {
+  std::vector<Evaluation> results(threads);
+  auto work = [&](int t) {
+    int begin = runners * t / threads, end = runners * (t + 1) / threads;
+    int n = end - begin;
+    // a stream per runner, the score doesn't depend on the thread count
+    std::vector<NN_rng_t> rngs(n);
+    for (int k = 0; k < n; k++)
+      rngs[k] = NN_rng_stream(1234 + begin + k);
+    auto place = [&](int k) { return NN_rng_random(&rngs[k], 1.0, -0.5); };
+    auto wander = [&](int k) { return std::min(1.0, floor(NN_rng_random(&rngs[k], 3.0, -1.0))); };
+    std::vector<Vector2> chasers(n), runnersPos(n);
+    std::vector<int> active(n, 1);
+    std::vector<double> inputs(n * 4), outputs(n * 2);
+    for (int k = 0; k < n; k++) {
+      chasers[k] = Vector2(place(k), place(k));
+      runnersPos[k] = Vector2(place(k), place(k));
+    }
+    Evaluation &r = results[t];
+    for (int step = 0; step < maxSteps; step++) {
+      for (int k = 0; k < n; k++) {
+        inputs[k * 4 + 0] = chasers[k].x;
+        inputs[k * 4 + 1] = chasers[k].y;
+        inputs[k * 4 + 2] = runnersPos[k].x;
+        inputs[k * 4 + 3] = runnersPos[k].y;
+      }
+      NN_forward_batch(nn, inputs.data(), outputs.data(), n);
+      for (int k = 0; k < n; k++) {
+        if (!active[k])
+          continue;
+        Vector2 &runner = runnersPos[k];
+        runner = runner + Vector2(wander(k), wander(k)) * 0.002;
+        runner.x = std::clamp(runner.x, -0.5, 0.5);
+        runner.y = std::clamp(runner.y, -0.5, 0.5);
+        chasers[k] = chasers[k] + Vector2(outputs[k * 2], outputs[k * 2 + 1]) * Game::chaserSpeed;
+        if ((runner - chasers[k]).length() < radius) {
+          active[k] = 0;
+          r.caught++;
+          r.catchSteps += step + 1;
+        }
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; t++)
+    pool.emplace_back(work, t);
+  for (auto &th : pool)
+    th.join();
+  Evaluation total;
+  for (auto &r : results) {
+    total.caught += r.caught;
+    total.catchSteps += r.catchSteps;
+  }
+  return total;
+}
+
+int main(int argc, char *args[]) {
+  setbuf( stdout, NULL);
+
+  int epochs = argc > 1 ? atoi(args[1]) : 10;
+  int batch = argc > 2 ? atoi(args[2]) : 32;
+  int threads = argc > 3 ? atoi(args[3]) : (int) std::max(1u, std::thread::hardware_concurrency());
+  int runners = argc > 4 ? atoi(args[4]) : 4096;
+  batch = std::max(1, batch);
+  threads = std::max(1, threads);
+
+  using clock = std::chrono::steady_clock;
+  auto secs = [](clock::time_point since) {
+    return std::chrono::duration<double>(clock::now() - since).count();
+  };
+
+  Dataset data;
+  auto start = clock::now();
+  data.generate(g.trainingPts, g.trainingPts2, threads);
+  printf("generated %d pairs in %.3f s\n", data.count, secs(start));
+
+  std::mt19937 rng(42);
+  for (int e = 0; e < epochs; e++) {
+    start = clock::now();
+    data.shuffle(rng);
+    double mse = 0.0;
+    for (int base = 0; base < data.count; base += batch) {
+      int rows = std::min(batch, data.count - base);
+      mse += rows * NN_train_batch(g.nn, &data.inputs[(size_t) base * 4], &data.targets[(size_t) base * 2], rows);
+    }
+    double elapsed = secs(start);
+    printf("epoch %d | mse %.6f | %.0f samples/s\n", e + 1, mse / data.count, data.count / elapsed);
+  }
+
+  start = clock::now();
+  Evaluation r = evaluate(g.nn, runners, threads);
+  printf("caught %d / %d runners (%.1f%%), %.1f steps on average, %.3f s\n", r.caught, runners, 100.0 * r.caught / runners,
+         r.caught ? (double) r.catchSteps / r.caught : 0.0, secs(start));
+  return 0;  // ~Game writes nn.txt
+}
@@ -3,6 +3,7 @@
 #include <cmath>
 #include <vector>
 #include <algorithm>
+#include <numeric>
 #include <map>
 
 using namespace std;
@@ -13,31 +14,23 @@ struct Binner {
   vector<double> centroids;
   vector<string> values;
   vector<vector<double>> clusters;
+  vector<int> order;  // centroid indexes sorted by value, equal values by index
 
-  void createBins(std::vector<double> &data, string tag) {
+  // sqrt(n) clusters, no more than maxClusters when that is above 0
+  void createBins(std::vector<double> &data, string tag, int maxClusters = 0) {
     numClusters = int(sqrt(double(data.size())));
     numClusters = 0 == numClusters ? 1 : numClusters;
+    if (maxClusters > 0)
+      numClusters = min(numClusters, maxClusters);
 
+    centroids.clear();
     for (int i = 0; i < numClusters; i++) {
-      int index =
+      int index = 1 == numClusters ? 0 :
           (double(i) / double(numClusters - 1) * double(data.size() - 1));
       centroids.push_back(data[index]);
     }
     clusters = vector<vector<double>>(numClusters);
 
-    auto get_cluster = [&](double v) {
-      int cluster = 0;
-      double dist = fabs(centroids[cluster] - v);
-      for (int i = 1; i < int(centroids.size()); i++) {
-        double dist2 = fabs(centroids[i] - v);
-        if (dist2 < dist) {
-          cluster = i;
-          dist = dist2;
-        }
-      }
-      return cluster;
-    };
-
     auto get_centroid = [=](std::vector<double> &values) {
       if (values.empty())
         return 0.0;
@@ -51,8 +44,9 @@ struct Binner {
       for (auto &cluster : clusters)
         cluster.clear();
 
+      sortCentroids();
       for (auto value : data) {
-        auto cluster = get_cluster(value);
+        auto cluster = this->cluster(value);
         clusters[cluster].push_back(value);
       }
       for (size_t i = 0; i < clusters.size(); i++) {
@@ -62,6 +56,7 @@ struct Binner {
 
     for (int i = 0; i < 50; i++)
       learn();
+    sortCentroids();
 
     values.clear();
     for (int i = 0; i < (int) centroids.size(); i++) {
@@ -69,17 +64,36 @@ struct Binner {
     }
   }
 
-  string bin(double value) {
-    int cluster = 0;
-    double dist = fabs(centroids[cluster] - value);
-    for (int i = 1; i < int(centroids.size()); i++) {
-      double dist2 = fabs(centroids[i] - value);
-      if (dist2 < dist) {
-        cluster = i;
-        dist = dist2;
-      }
-    }
-    return values[cluster];
+  void sortCentroids() {
+    order.resize(centroids.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&](int a, int b) {
+      return centroids[a] < centroids[b];
+    });
+  }
+
+  // index of the nearest centroid, the lowest one among equally near ones: a binary search over the
+  // sorted centroids, the nearest is the first of the run of equal centroids on either side of value
+  int cluster(double value) const {
+    auto first = [&](double centroid) {
+      return int(lower_bound(order.begin(), order.end(), centroid, [&](int i, double v) {
+        return centroids[i] < v;
+      }) - order.begin());
+    };
+    int above = first(value), count = int(order.size());
+    if (above == count)
+      return order[first(centroids[order[count - 1]])];
+    if (0 == above)
+      return order[0];
+    int a = order[first(centroids[order[above - 1]])], b = order[above];
+    double dist = fabs(centroids[a] - value), dist2 = fabs(centroids[b] - value);
+    if (dist2 < dist || (dist2 == dist && b < a))
+      return b;
+    return a;
+  }
+
+  string bin(double value) const {
+    return values[cluster(value)];
   }
 
 };
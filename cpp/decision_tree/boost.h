@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "binner.h"
+#include "dataset.h"
+#include "pool.h"
+
+using namespace std;
+
+// gradient boosting on the Yes/No label with logistic loss. Every feature is binned once into at most 256
+// uint8 bins: numeric columns by their k-means bins (binner.h) in value order, categorical ones by code; a
+// categorical column with more codes than bins is regrouped every round, runs of codes ranked by gradient.
+// Each round fits a regression tree to the loss's gradients and hessians: a node sums them per bin into a
+// histogram and scans it for the best split; a parent's histogram minus its smaller child's is the other's.
+
+struct BoostParams {
+  int rounds = 100;
+  double learningRate = 0.1;  // shrinks every tree's leaves
+  int maxDepth = 4;
+  int minSamplesLeaf = 5;
+  double lambda = 1.0;        // L2 on leaf values
+  int maxBins = 256;
+  int parallelRows = 4096;    // smaller nodes build their histograms on one thread
+};
+
+struct BoostNode {
+  int feature = -1;           // -1 for a leaf
+  int bin = 0;                // numeric split: bins <= bin go left
+  double threshold = 0.0;     // the same split on raw values: below threshold goes left
+  vector<signed char> sides;  // categorical split, per code: 0 left, 1 right, -1 no row here had it
+  int unknown = 0;            // side for a code the split never saw, the one more rows went to
+  int children[2] = { -1, -1 };
+  double value = 0.0;         // leaf score, learning rate applied
+
+  bool isLeaf() const {
+    return feature < 0;
+  }
+};
+
+struct GradientBoosting {
+  BoostParams params;
+  double base = 0.0;  // log odds of yes over the training rows
+  vector<vector<BoostNode>> trees;
+  vector<vector<double>> edges;  // numeric features: bin b holds values in [edges[b - 1], edges[b])
+  vector<vector<uint8_t>> bins;  // per feature, per training row
+  vector<vector<uint8_t>> codeBins;  // categorical features: bin per code
+
+  void build(const Dataset &dataset, const BoostParams &params_, TaskPool *pool = nullptr) {
+    params = params_;
+    trees.clear();
+    binFeatures(dataset);
+    int rows = dataset.rows;
+    if (0 == rows)
+      return;
+
+    int yes = 0;
+    for (int i = 0; i < rows; i++)
+      yes += dataset.label(i);
+    base = log((yes + 1.0) / (rows - yes + 1.0));
+    scores.assign(rows, base);
+    gradients.resize(rows);
+    hessians.resize(rows);
+    vector<int> order(rows);
+    for (int round = 0; round < params.rounds; round++) {
+      for (int i = 0; i < rows; i++) {
+        double p = 1.0 / (1.0 + exp(-scores[i]));
+        gradients[i] = p - double(dataset.label(i));
+        hessians[i] = max(p * (1.0 - p), 1e-12);
+      }
+      groupCategories(dataset);
+      for (int i = 0; i < rows; i++)
+        order[i] = i;
+      trees.push_back(vector<BoostNode>());
+      vector<Histogram> histograms;
+      fill(dataset, order.data(), rows, histograms, pool);
+      grow(dataset, trees.back(), order.data(), rows, 0, histograms, pool);
+    }
+  }
+
+  // probability of yes for a point: value(feature) is its number in a numeric column, its code (-1 when
+  // unseen) otherwise, as for DecisionTree::leaf
+  template <class Value>
+  double probability(const Dataset &dataset, Value value) const {
+    double score = base;
+    for (auto &tree : trees) {
+      const BoostNode *node = &tree[0];
+      while (!node->isLeaf()) {
+        int side;
+        if (dataset.columns[node->feature].numeric)
+          side = value(node->feature) < node->threshold ? 0 : 1;
+        else {
+          int code = int(value(node->feature));
+          side = code < 0 || code >= int(node->sides.size()) || node->sides[code] < 0 ? node->unknown : node->sides[code];
+        }
+        node = &tree[node->children[side]];
+      }
+      score += node->value;
+    }
+    return 1.0 / (1.0 + exp(-score));
+  }
+
+  // mean logistic loss of the trained scores
+  double loss(const Dataset &dataset) const {
+    double sum = 0.0;
+    for (int i = 0; i < dataset.rows; i++) {
+      double p = 1.0 / (1.0 + exp(-scores[i]));
+      sum -= log(max(1e-15, dataset.label(i) ? p : 1.0 - p));
+    }
+    return dataset.rows ? sum / dataset.rows : 0.0;
+  }
+
+private:
+  struct Bin {
+    double gradient = 0.0;
+    double hessian = 0.0;
+    int count = 0;
+  };
+  using Histogram = vector<Bin>;  // one per feature
+
+  vector<double> scores;  // raw score per training row
+  vector<double> gradients;
+  vector<double> hessians;
+
+  // numeric columns: Binner centroids in value order, a bin edge halfway between neighbours;
+  // categorical columns: their codes, groupCategories bins the ones with more codes than bins
+  void binFeatures(const Dataset &dataset) {
+    int features = int(dataset.columns.size());
+    int maxBins = max(2, min(256, params.maxBins));
+    edges.assign(features, vector<double>());
+    bins.assign(features, vector<uint8_t>(dataset.rows));
+    codeBins.assign(features, vector<uint8_t>());
+    for (int feature = 0; feature < features; feature++) {
+      const auto &column = dataset.columns[feature];
+      if (!column.numeric) {
+        if (column.cardinality() > maxBins)
+          continue;
+        for (int code = 0; code < column.cardinality(); code++)
+          codeBins[feature].push_back(uint8_t(code));
+        for (int i = 0; i < dataset.rows; i++)
+          bins[feature][i] = uint8_t(column.codes[i]);
+        continue;
+      }
+      vector<double> numbers = column.numbers;
+      Binner binner;
+      binner.createBins(numbers, column.name, maxBins);
+      auto &edge = edges[feature];
+      for (int k = 1; k < int(binner.order.size()); k++) {
+        double lo = binner.centroids[binner.order[k - 1]], hi = binner.centroids[binner.order[k]];
+        if (hi > lo)
+          edge.push_back(0.5 * (lo + hi));
+      }
+      for (int i = 0; i < dataset.rows; i++)
+        bins[feature][i] = uint8_t(upper_bound(edge.begin(), edge.end(), column.numbers[i]) - edge.begin());
+    }
+  }
+
+  // categorical columns with more codes than bins: codes ranked by gradient over hessian on every row, as
+  // search ranks bins, and cut into runs of about equal row counts. A split between runs is one the codes
+  // themselves would allow, and codes that pull the same way share a bin instead of whichever came last.
+  void groupCategories(const Dataset &dataset) {
+    int maxBins = max(2, min(256, params.maxBins));
+    for (int feature = 0; feature < int(dataset.columns.size()); feature++) {
+      const auto &column = dataset.columns[feature];
+      int cardinality = column.cardinality();
+      if (column.numeric || cardinality <= maxBins)
+        continue;
+      Histogram sums(cardinality);
+      for (int i = 0; i < dataset.rows; i++) {
+        Bin &bin = sums[column.codes[i]];
+        bin.gradient += gradients[i];
+        bin.hessian += hessians[i];
+        bin.count++;
+      }
+      vector<int> order(cardinality);
+      for (int code = 0; code < cardinality; code++)
+        order[code] = code;
+      sort(order.begin(), order.end(), [&](int a, int b) {
+        return sums[a].gradient / (sums[a].hessian + params.lambda) < sums[b].gradient / (sums[b].hessian + params.lambda);
+      });
+      auto &codeBin = codeBins[feature];
+      codeBin.resize(cardinality);
+      int64_t seen = 0;
+      for (int code : order) {
+        codeBin[code] = uint8_t(seen * maxBins / dataset.rows);
+        seen += sums[code].count;
+      }
+      for (int i = 0; i < dataset.rows; i++)
+        bins[feature][i] = codeBin[column.codes[i]];
+    }
+  }
+
+  int binCount(const Dataset &dataset, int feature) const {
+    if (dataset.columns[feature].numeric)
+      return int(edges[feature].size()) + 1;
+    return min(dataset.columns[feature].cardinality(), max(2, min(256, params.maxBins)));
+  }
+
+  void fill(const Dataset &dataset, const int *rows, int count, vector<Histogram> &histograms, TaskPool *pool) const {
+    int features = int(dataset.columns.size());
+    histograms.assign(features, Histogram());
+    auto one = [&, rows, count](int feature) {
+      Histogram &histogram = histograms[feature];
+      histogram.assign(binCount(dataset, feature), Bin());
+      const uint8_t *codes = bins[feature].data();
+      for (int i = 0; i < count; i++) {
+        Bin &bin = histogram[codes[rows[i]]];
+        bin.gradient += gradients[rows[i]];
+        bin.hessian += hessians[rows[i]];
+        bin.count++;
+      }
+    };
+    if (pool && count >= params.parallelRows && features > 1) {
+      TaskPool::Group group;
+      for (int feature = 0; feature < features; feature++)
+        pool->run(group, [&one, feature]() {
+          one(feature);
+        });
+      pool->wait(group);
+    } else
+      for (int feature = 0; feature < features; feature++)
+        one(feature);
+  }
+
+  double score(double gradient, double hessian) const {
+    return gradient * gradient / (hessian + params.lambda);
+  }
+
+  struct Split {
+    int feature = -1;
+    double gain = 0.0;
+    int bin = 0;
+    vector<signed char> sides;  // categorical, per bin as BoostNode::sides is per code
+  };
+
+  // numeric: every bin boundary in order; categorical: bins ordered by gradient over hessian, the prefixes
+  void search(const Dataset &dataset, int feature, const Histogram &histogram, double gradient, double hessian,
+              int count, Split &best) const {
+    int n = int(histogram.size());
+    vector<int> order;
+    for (int b = 0; b < n; b++)
+      if (histogram[b].count > 0)
+        order.push_back(b);
+    if (order.size() < 2)
+      return;
+    bool numeric = dataset.columns[feature].numeric;
+    if (!numeric)
+      sort(order.begin(), order.end(), [&](int a, int b) {
+        return histogram[a].gradient / (histogram[a].hessian + params.lambda)
+            < histogram[b].gradient / (histogram[b].hessian + params.lambda);
+      });
+    double parent = score(gradient, hessian), leftGradient = 0.0, leftHessian = 0.0;
+    int left = 0, prefix = -1;
+    for (int k = 0; k < int(order.size()) - 1; k++) {
+      const Bin &bin = histogram[order[k]];
+      leftGradient += bin.gradient;
+      leftHessian += bin.hessian;
+      left += bin.count;
+      if (left < params.minSamplesLeaf || count - left < params.minSamplesLeaf)
+        continue;
+      double gain = score(leftGradient, leftHessian) + score(gradient - leftGradient, hessian - leftHessian) - parent;
+      if (gain > best.gain + 1e-12) {
+        best.feature = feature;
+        best.gain = gain;
+        best.bin = order[k];
+        prefix = k;
+      }
+    }
+    if (prefix < 0 || numeric)
+      return;
+    best.sides.assign(n, -1);
+    for (int k = 0; k < int(order.size()); k++)
+      best.sides[order[k]] = k <= prefix ? 0 : 1;
+  }
+
+  // histograms holds the node's own, consumed: the bigger child gets them less the smaller child's
+  int grow(const Dataset &dataset, vector<BoostNode> &tree, int *rows, int count, int depth,
+           vector<Histogram> &histograms, TaskPool *pool) {
+    int index = int(tree.size());
+    tree.push_back(BoostNode());
+    double gradient = 0.0, hessian = 0.0;  // any feature's histogram sums to the node's
+    for (int b = 0; !histograms.empty() && b < int(histograms[0].size()); b++) {
+      gradient += histograms[0][b].gradient;
+      hessian += histograms[0][b].hessian;
+    }
+
+    Split best;
+    if (depth < params.maxDepth && count >= 2 * params.minSamplesLeaf)
+      for (int feature = 0; feature < int(dataset.columns.size()); feature++)
+        search(dataset, feature, histograms[feature], gradient, hessian, count, best);
+    if (best.feature < 0) {
+      double value = -params.learningRate * gradient / (hessian + params.lambda);
+      tree[index].value = value;
+      for (int i = 0; i < count; i++)
+        scores[rows[i]] += value;
+      return index;
+    }
+
+    BoostNode &node = tree[index];
+    node.feature = best.feature;
+    node.bin = best.bin;
+    bool numeric = dataset.columns[best.feature].numeric;
+    if (numeric)
+      node.threshold = edges[best.feature][best.bin];
+    else {
+      // codes sharing a bin share its side
+      const auto &codeBin = codeBins[best.feature];
+      node.sides.resize(codeBin.size());
+      for (int code = 0; code < int(codeBin.size()); code++)
+        node.sides[code] = best.sides[codeBin[code]];
+    }
+    const uint8_t *codes = bins[best.feature].data();
+    int *middle = std::partition(rows, rows + count, [&](int row) {
+      if (numeric)
+        return codes[row] <= node.bin;
+      return 0 == best.sides[codes[row]];
+    });
+    int left = int(middle - rows);
+    node.unknown = left >= count - left ? 0 : 1;
+
+    // the smaller child scans its rows, the bigger one subtracts
+    int *childRows[2] = { rows, middle };
+    int childCounts[2] = { left, count - left };
+    int small = left <= count - left ? 0 : 1;
+    vector<Histogram> smaller;
+    fill(dataset, childRows[small], childCounts[small], smaller, pool);
+    for (int feature = 0; feature < int(histograms.size()); feature++)
+      for (int b = 0; b < int(histograms[feature].size()); b++) {
+        histograms[feature][b].gradient -= smaller[feature][b].gradient;
+        histograms[feature][b].hessian -= smaller[feature][b].hessian;
+        histograms[feature][b].count -= smaller[feature][b].count;
+      }
+    int children[2];
+    children[small] = grow(dataset, tree, childRows[small], childCounts[small], depth + 1, smaller, pool);
+    children[1 - small] = grow(dataset, tree, childRows[1 - small], childCounts[1 - small], depth + 1, histograms, pool);
+    tree[index].children[0] = children[0];
+    tree[index].children[1] = children[1];
+    return index;
+  }
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+#include "binner.h"
+
+using namespace std;
+
+// one feature stored column-wise, every row holds a small integer code into the column's dictionary
+struct Column {
+  string name;
+  bool numeric = true;        // every value so far is a number, cleared by the first one that is not
+  bool wide = false;          // a numeric column with more distinct values than codes, only numbers kept
+  vector<double> numbers;     // raw values of a numeric column, its codes are bin numbers
+  vector<uint16_t> codes;     // one per row
+  vector<string> dictionary;  // code -> value
+  unordered_map<string, uint16_t> lookup;
+  Binner bins;                // numeric columns only
+
+  int cardinality() const {
+    return int(dictionary.size());
+  }
+
+  // code of a known value, -1 for one the training data never had
+  int find(string_view value) const {
+    auto it = lookup.find(string(value));
+    return it == lookup.end() ? -1 : int(it->second);
+  }
+
+  int find(double value) const {
+    return numeric ? bins.cluster(value) : -1;
+  }
+
+  // codes are 16 bit: a categorical column takes up to 65536 distinct values, false past that
+  bool push(const char *value) {
+    if (numeric) {
+      for (const char *c = value; *c; c++)
+        if (!isdigit((unsigned char) *c)) {
+          numeric = false;
+          break;
+        }
+      if (numeric)
+        numbers.push_back(atof(value));
+    }
+    if (wide)
+      return numeric;
+    auto it = lookup.find(value);
+    if (it == lookup.end()) {
+      if (dictionary.size() > UINT16_MAX) {
+        if (!numeric)
+          return false;
+        // too many values to code but all numbers so far, keep only those, they get binned at the end
+        wide = true;
+        codes.clear();
+        dictionary.clear();
+        lookup.clear();
+        return true;
+      }
+      it = lookup.emplace(value, uint16_t(dictionary.size())).first;
+      dictionary.push_back(value);
+    }
+    codes.push_back(it->second);
+    return true;
+  }
+
+  // numeric columns become their k-means bins (binner.h), the bin names make the dictionary
+  void finish() {
+    if (!numeric || numbers.empty()) {
+      numbers.clear();
+      return;
+    }
+    bins.createBins(numbers, name);
+    dictionary = bins.values;
+    lookup.clear();
+    for (int i = 0; i < int(dictionary.size()); i++)
+      lookup[dictionary[i]] = uint16_t(i);
+    codes.resize(numbers.size());
+    for (size_t i = 0; i < numbers.size(); i++)
+      codes[i] = uint16_t(bins.cluster(numbers[i]));
+  }
+};
+
+// features as dictionary-encoded columns, the Yes/No label as a bitvector
+struct Dataset {
+  vector<Column> columns;   // every feature but the label
+  string labelName = "Label";
+  vector<uint64_t> labels;  // bit per row, set for "Yes"
+  int rows = 0;
+
+  bool label(int row) const {
+    return (labels[row >> 6] >> (row & 63)) & 1;
+  }
+
+  int column(string_view name) const {
+    for (int i = 0; i < int(columns.size()); i++)
+      if (columns[i].name == name)
+        return i;
+    return -1;
+  }
+
+  // header line names the columns, rows missing fields are skipped; returns false when the file can't be read
+  bool load(string_view fileName) {
+    FILE *fp = fopen(fileName.data(), "r");
+    if (!fp)
+      return false;
+    char line[1024];
+    char *token = nullptr;
+    int labelIndex = -1;
+    vector<int> order;  // file column -> dataset column, -1 for the label
+    columns.clear();
+    labels.clear();
+    rows = 0;
+    if (fgets(line, sizeof(line), fp)) {
+      token = strtok(line, ",\n\r\t");
+      while (token) {
+        if (labelName == token) {
+          labelIndex = int(order.size());
+          order.push_back(-1);
+        } else {
+          order.push_back(int(columns.size()));
+          columns.push_back(Column());
+          columns.back().name = token;
+        }
+        token = strtok(nullptr, ",\n\r\t");
+      }
+    }
+
+    bool ok = true;
+    int skipped = 0;
+    vector<char*> fields(order.size());
+    while (ok && fgets(line, sizeof(line), fp)) {
+      int count = 0;
+      token = strtok(line, ",\n\r");
+      for (; token && count < int(fields.size()); count++) {
+        fields[count] = token;
+        token = strtok(nullptr, ",\n\r");
+      }
+      if (0 == count)
+        continue;
+      if (count < int(fields.size())) {
+        skipped++;  // every column must keep one value per row
+        continue;
+      }
+      if (0 == (rows & 63))
+        labels.push_back(0);
+      for (int i = 0; i < count; i++) {
+        if (i == labelIndex) {
+          if (0 == strcmp(fields[i], "Yes"))
+            labels.back() |= uint64_t(1) << (rows & 63);
+        } else if (!columns[order[i]].push(fields[i])) {
+          printf("column '%s' has too many distinct values\n", columns[order[i]].name.c_str());
+          ok = false;
+        }
+      }
+      rows++;
+    }
+    fclose(fp);
+    if (skipped)
+      printf("skipped %d rows with missing fields\n", skipped);
+    for (auto &column : columns)
+      column.finish();
+    return ok;
+  }
+};
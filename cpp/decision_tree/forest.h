@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "dataset.h"
+#include "pool.h"
+#include "tree.h"
+
+using namespace std;
+
+// bagged CART trees: each grows on a bootstrap sample of the rows and searches a random subset of
+// features per node; the rows a tree's sample left out (out of bag) give a free accuracy estimate
+struct ForestParams {
+  int trees = 64;
+  int maxFeatures = 0;   // per node, 0 for sqrt of the feature count
+  uint64_t seed = 1;     // the same seed grows the same forest on any number of threads
+  bool average = true;   // average the leaves' yes shares, or count each tree's vote
+  TreeParams tree;
+};
+
+struct RandomForest {
+  vector<DecisionTree> trees;
+  ForestParams params;
+  double oobAccuracy = 0.0;  // over the rows at least one tree left out
+  int oobRows = 0;
+
+  void build(const Dataset &dataset, const ForestParams &params_, TaskPool &pool) {
+    params = params_;
+    int count = params.trees;
+    trees.assign(count, DecisionTree());
+    vector<vector<char>> inBag(count);  // per tree, rows its sample drew
+    int features = int(dataset.columns.size());
+    int maxFeatures = params.maxFeatures > 0 ? params.maxFeatures : max(1, int(sqrt(double(features)) + 0.5));
+
+    TaskPool::Group group;
+    for (int t = 0; t < count; t++)
+      pool.run(group, [&, t]() {
+        uint64_t state = params.seed * 0x9e3779b97f4a7c15ull + uint64_t(t);
+        vector<int> rows(dataset.rows);
+        inBag[t].assign(dataset.rows, 0);
+        for (int i = 0; i < dataset.rows; i++) {
+          rows[i] = int(DecisionTree::mix(state) % uint64_t(dataset.rows));
+          inBag[t][rows[i]] = 1;
+        }
+        TreeParams treeParams = params.tree;
+        treeParams.maxFeatures = maxFeatures;
+        treeParams.seed = DecisionTree::mix(state);
+        trees[t].build(dataset, rows, treeParams);
+      });
+    pool.wait(group);
+
+    // each row is predicted by the trees that never saw it
+    int corrects = 0;
+    oobRows = 0;
+    for (int row = 0; row < dataset.rows; row++) {
+      double sum = 0.0;
+      int votes = 0;
+      for (int t = 0; t < count; t++) {
+        if (inBag[t][row] || trees[t].nodes.empty())
+          continue;
+        sum += score(trees[t].leaf(dataset, row));
+        votes++;
+      }
+      if (0 == votes)
+        continue;
+      oobRows++;
+      corrects += (sum >= 0.5 * votes) == dataset.label(row);
+    }
+    oobAccuracy = oobRows ? double(corrects) / double(oobRows) : 0.0;
+  }
+
+  // share of yes over the trees for a point, value(feature) as for DecisionTree::leaf
+  template <class Value>
+  double probability(const Dataset &dataset, Value value) const {
+    double sum = 0.0;
+    int votes = 0;
+    for (auto &tree : trees) {
+      if (tree.nodes.empty())
+        continue;
+      sum += score(tree.leaf(dataset, value));
+      votes++;
+    }
+    return votes ? sum / votes : 0.0;
+  }
+
+  // probabilities of yes for a batch of the dataset's rows, split across the pool
+  void predict(const Dataset &dataset, const int *rows, int count, double *probabilities, TaskPool &pool) const {
+    TaskPool::Group group;
+    int chunk = max(256, count / (4 * pool.size()) + 1);
+    for (int begin = 0; begin < count; begin += chunk)
+      pool.run(group, [&, begin]() {
+        int end = min(count, begin + chunk);
+        for (int i = begin; i < end; i++)
+          probabilities[i] = probability(dataset, [&](int feature) {
+            return DecisionTree::value(dataset, feature, rows[i]);
+          });
+      });
+    pool.wait(group);
+  }
+
+private:
+  // a tree's say for a point: its leaf's yes share, or a whole vote for the leaf's label
+  double score(const TreeNode &leaf) const {
+    if (!params.average)
+      return leaf.label() ? 1.0 : 0.0;
+    return double(leaf.yes) / double(max(1, leaf.yes + leaf.no));
+  }
+};
@@ -18,244 +18,132 @@
 
 #include "binner.h"
 #include "datagen.h"
+#include "dataset.h"
+#include "tree.h"
+#include "forest.h"
+#include "boost.h"
 
 #define CLAMP( v, a, b ){ v = v < (a) ? (a) : v > (b) ? (b) : v; }
 
 using namespace std;
 
 struct Gini {
-  string value = "";
+  int code = 0;  // the value, in its column's dictionary
   int ys = 0;
   int ns = 0;
   int total = 0;
   double impurity = 0.0;
 };
 
-vector<string> features;
-map<string, vector<Gini>> featureGinis;
-map<string, set<string>> featureValues;
-vector<string> sortedFeatures;
-map<string, map<string, Gini>> featureValueGini;
-
-map<string, double> featureImpurity;
-map<string, vector<string>> dataset;
-vector<unordered_map<string, string>> datapoints;
-std::map<string, Binner> featureBins;
-
-struct Node {
-  string feature = "";
-  unordered_map<string, Node*> children;
-  struct Label {
-    int no = 0;
-    int yes = 0;
-    string value() {
-      return no > yes ? "No" : "Yes";
-    }
-  };
-  optional<Label> label;
-  bool isLeaf() {
-    return label.has_value();
-  }
-};
-
-Node *tree = nullptr;
-
-Node* createNode(int index) {
-  int last = int(sortedFeatures.size()) - 1;
-  if (index > last)
-    return nullptr;
-
-  Node *node = new Node;
-  node->feature = sortedFeatures[index];
-  if (index == last) {
-    node->label = Node::Label();
-    return node;
-  }
-  auto &values = featureValues[node->feature];
-  for (auto value : values) {
-    auto &gini = featureValueGini[node->feature][value];
-    if (gini.impurity < 0.4)
-      node->children[value] = createNode(index + 1);  // good question, ask another one!
-    else {
-      // question's response will be mixed, this line of questioning is a fail so we rely on odds
-      node->children[value] = new Node;
-      node->children[value]->feature = node->feature;
-      node->children[value]->label = Node::Label();
-    }
+Dataset dataset;
+vector<vector<Gini>> featureGinis;  // column -> code -> gini
+vector<double> featureImpurity;
+
+DecisionTree tree;
+TreeParams treeParams;
+RandomForest forest;
+ForestParams forestParams;
+GradientBoosting boosting;
+BoostParams boostParams;
+TaskPool pool;  // a worker per core
+
+// one step of a path: the question the node asked and the point's answer
+string step(const TreeNode &node, int side, double value) {
+  const auto &column = dataset.columns[node.feature];
+  if (column.numeric) {
+    char text[64];
+    snprintf(text, sizeof(text), "%s%.6g", side ? ">" : "<=", node.threshold);
+    return column.name + text;
   }
-  return node;
+  int code = int(value);
+  return column.name + "=" + (code < 0 ? string("?") : column.dictionary[code]);
 }
 
-
-void walkNodes(Node *node, unordered_map<string, string> &datapoint,
-                vector<string> &path) {
-  auto value = datapoint[node->feature];
-
-  // a high count of either "yes" or "no" indicates good odds of picking the right one
-  if (node->isLeaf()) {
-    if (datapoint["Label"] == "Yes")
-      node->label->yes++;
-    else
-      node->label->no++;
-    path.push_back('(' + node->label->value() + ')');
-    return;
-  }
-
-  path.push_back(node->feature + "=" + value);
-  for (auto& [v, n] : node->children) {
-    if (v == value && n) {
-      path.push_back("->");
-      walkNodes(n, datapoint, path);
-      return;
-    }
+// value(feature) is the point's number in a numeric column, its code (-1 when unseen) otherwise; returns the leaf's label
+template <class Value>
+bool classify(Value value, vector<string> &path) {
+  const TreeNode *node = &tree.nodes[0];
+  while (!node->isLeaf()) {
+    int side = tree.side(*node, dataset, value);
+    path.push_back(step(*node, side, value(node->feature)));
+    path.push_back("->");
+    node = &tree.nodes[node->children[side]];
   }
+  path.push_back(string("(") + (node->label() ? "Yes" : "No") + ")");
+  return node->label();
 }
 
-string classify(Node *node, unordered_map<string, string> &datapoint,
-                 vector<string> &path) {
-  auto value = datapoint[node->feature];
-
-  if (node->isLeaf()) {
-    path.push_back('(' + node->label->value() + ')');
-    return node->label->yes >= node->label->no ? "Yes" : "No";
-  }
-
-  path.push_back(node->feature + "=" + value);
-  for (auto& [childValue, child] : node->children) {
-    if (child && childValue == value) {
-      path.push_back("->");
-      return classify(child, datapoint, path);
-    }
-  }
-  return "???";
-}
-
-void printNodes(Node *node, int indent, FILE *fp) {
-  if (!node)
-    return;  // Base case: if the node is null, do nothing
-
+void printNodes(int index, int indent, FILE *fp) {
   auto spaces = [](int count) {
-    char blanks[32] = { '\0' };
-    for (int i = 0; i < count; i++)
-      blanks[i] = ' ';
-    return string(blanks);
+    return string(count, ' ');
   };
 
-  if (node->isLeaf()) {
+  const TreeNode &node = tree.nodes[index];
+  if (node.isLeaf()) {
+    fprintf(fp, "%s(%s: %d yes, %d no)\n", spaces(indent).c_str(), node.label() ? "Yes" : "No", node.yes, node.no);
     return;
   }
 
-  // Print the feature of the current node
-  fprintf(fp, "%s%s\n", spaces(indent).c_str(), node->feature.c_str());
-  indent += 2;
-  // Iterate through children and print each one
-  for (const auto &child : node->children) {
-    fprintf(fp, "%s%s:\n", spaces(indent).c_str(), child.first.c_str());  // Print the edge
-    printNodes(child.second, indent + 2, fp);  // Recursively print the child node with increased indentation
+  // Print the question, then each side's subtree with increased indentation
+  const auto &column = dataset.columns[node.feature];
+  for (int side = 0; side < 2; side++) {
+    if (column.numeric)
+      fprintf(fp, "%s%s %s %.6g:\n", spaces(indent).c_str(), column.name.c_str(), side ? ">" : "<=", node.threshold);
+    else {
+      string values;
+      for (int code = 0; code < int(node.sides.size()); code++) {
+        if (node.sides[code] != side)
+          continue;
+        values += values.empty() ? "" : ", ";
+        values += column.dictionary[code];
+      }
+      fprintf(fp, "%s%s in {%s}:\n", spaces(indent).c_str(), column.name.c_str(), values.c_str());
+    }
+    printNodes(node.children[side], indent + 2, fp);
   }
 }
 
-void loadFile(string_view name = "dataset5.csv") {
-  FILE *fp = fopen(name.data(), "r");
-  char line[1024];
-  char *token = nullptr;
-  fgets(line, sizeof(line), fp);
-  token = strtok(line, ",\n\r\t");
-  while (token) {
-    features.push_back(string(token));
-    token = strtok(nullptr, ",\n\r\t");
-  }
-
-  while (fgets(line, sizeof(line), fp)) {
-    token = strtok(line, ",\n\r");
-    for (auto feature : features) {
-      dataset[feature].push_back(string(token));
-      token = strtok(nullptr, ",\n\r");
-    }
+// every value's gini from one pass over the column: a (value x label) count histogram
+vector<Gini> impurities(int feature) {
+  const auto &codes = dataset.columns[feature].codes;
+  int cardinality = dataset.columns[feature].cardinality();
+
+  // counts[code * 2 + label], the label bits come off their word in order with the rows
+  vector<int> counts(cardinality * 2);
+  for (int base = 0; base < dataset.rows; base += 64) {
+    uint64_t bits = dataset.labels[base >> 6];
+    int end = min(dataset.rows, base + 64);
+    for (int i = base; i < end; i++, bits >>= 1)
+      counts[codes[i] * 2 + int(bits & 1)]++;
   }
 
-  auto is_numeric = [=](const vector<string> &values) {
-    return std::all_of(values.begin(), values.end(), [](const string &value) {
-      for (auto c : value)
-        if (!isdigit(c))
-          return false;
-      return true;
-    });
-  };
-
-  for (auto feature : features) {
-    if (!is_numeric(dataset[feature]))
+  vector<Gini> ginis(cardinality);
+  for (int code = 0; code < cardinality; code++) {
+    Gini &gini = ginis[code];
+    gini.code = code;
+    gini.ns = counts[code * 2];
+    gini.ys = counts[code * 2 + 1];
+    gini.total = gini.ys + gini.ns;
+    if (0 == gini.total) {
+      gini.impurity = 1.0;
       continue;
-    printf("feature '%s' is continuous\n", feature.c_str());
-    vector<double> values;
-    for (auto value : dataset[feature]) {
-      double number;
-      stringstream ss;
-      ss << value;
-      ss >> number;
-      values.push_back(number);
     }
-    auto &binner = featureBins[feature];
-    binner.createBins(values, feature);
-    int i = 0;
-    for (auto &value : dataset[feature])
-      value = binner.bin(values[i++]);
-
-  }
-
-  int n = 0;
-  for (auto& [f, i] : dataset) {
-    n = int(i.size());
-    break;
-  }
-
-  for (int i = 0; i < n; i++) {
-    unordered_map<string, string> row;
-    for (auto feature : features)
-      row[feature] = dataset[feature][i];
-    datapoints.push_back(std::move(row));
+    double p = double(gini.ys) / double(gini.total);
+    double p2 = double(gini.ns) / double(gini.total);
+    gini.impurity = 1.0 - (p * p + p2 * p2);
   }
-
-//  for (auto& [f, i] : dataset) {
-//    printf("%d rows\n", int(i.size()));
-//  }
-//  for (auto feature : features) {
-//    printf("feature: '%s'\n", feature.c_str());
-//    for (auto instance : dataset[feature])
-//      printf(" + '%s'\n", instance.c_str());
-//  }
-}
-
-Gini impurity(string_view feature, string_view value) {
-  const auto &instances = dataset[string(feature)];
-  const auto &labelInstances = dataset["Label"];
-
-  Gini gini;
-  gini.value = string(value);
-  for (int i = 0; i < int(instances.size()); i++) {
-    if (instances[i] != value)
-      continue;
-    gini.total++;
-    if (labelInstances[i] == "Yes")
-      gini.ys++;
-    else
-      gini.ns++;
-  }
-  if (0 == gini.total) {
-    gini.impurity = 1.0;
-    return gini;
-  }
-
-  double p = double(gini.ys) / double(gini.total);
-  double p2 = double(gini.ns) / double(gini.total);
-
-  gini.impurity = 1.0 - (p * p + p2 * p2);
-  return gini;
+  return ginis;
 }
 
 void load() {
   printf("***************\n");
-  loadFile("dataset5.csv");
+  if (!dataset.load("dataset5.csv")) {
+    printf("can't load 'dataset5.csv'\n");
+    exit(1);
+  }
+  for (auto &column : dataset.columns)
+    if (column.numeric)
+      printf("feature '%s' is continuous\n", column.name.c_str());
   printf("***************\n");
 
   auto sum = [](vector<Gini> &ginis) {
@@ -268,102 +156,160 @@ void load() {
     return purity;
   };
 
-  for (auto &feature : features) {
-    set<string> unique(dataset[feature].begin(), dataset[feature].end());
-    featureValues[feature] = std::move(unique);
-    printf("feature: '%s'\n", feature.c_str());
-  }
+  int features = int(dataset.columns.size());
+  for (auto &column : dataset.columns)
+    printf("feature: '%s'\n", column.name.c_str());
 
-  for (auto &feature : features) {
-    auto &ginis = featureGinis[feature];
-    ginis.clear();
-    if (feature == "Label") {
-      featureImpurity[feature] = 1.0;
-      continue;
-    }
-    for (auto &value : featureValues[feature]) {
-      auto gini = impurity(feature, value);
-      featureValueGini[feature][value] = gini;
-      ginis.push_back(std::move(gini));
-    }
-    featureImpurity[feature] = sum(ginis);
+  featureGinis.resize(features);
+  featureImpurity.assign(features, 1.0);
+  for (int feature = 0; feature < features; feature++) {
+    featureGinis[feature] = impurities(feature);
+    featureImpurity[feature] = sum(featureGinis[feature]);
   }
 
   printf("***************\n");
-  for (auto &feature : features) {
+  for (int feature = 0; feature < features; feature++) {
+    auto &column = dataset.columns[feature];
     auto &ginis = featureGinis[feature];
-    printf("'%s': %lf\n", feature.c_str(), featureImpurity[feature]);
-    int n = int(ginis.size());
+    printf("'%s': %lf\n", column.name.c_str(), featureImpurity[feature]);
+    int n = int(count_if(ginis.begin(), ginis.end(), [](const Gini &gini) { return gini.total > 0; }));
     for (auto gini : ginis) {
-      printf(" + '%s' %.3lf (%d of %d: %lf)\n", gini.value.c_str(),
+      if (0 == gini.total)
+        continue;
+      printf(" + '%s' %.3lf (%d of %d: %lf)\n", column.dictionary[gini.code].c_str(),
              gini.impurity, gini.total, n, double(gini.total) / double(n));
     }
   }
 }
 
 void build() {
-  map<double, vector<string>> featureMap;
-  for (auto &feature : features) {
-    featureMap[featureImpurity[feature]].push_back(feature);
-  }
-  sortedFeatures.clear();
-  for (auto& [purity, features] : featureMap) {
-    if (0.0 == purity) {
-      sortedFeatures.push_back(features[0]);
+  vector<int> rows(dataset.rows);
+  for (int i = 0; i < dataset.rows; i++)
+    rows[i] = i;
+  tree.build(dataset, rows, treeParams, &pool);
+
+  int leaves = 0, depth = 0;
+  vector<int> depths(tree.nodes.size());
+  for (int i = 0; i < int(tree.nodes.size()); i++) {
+    const auto &node = tree.nodes[i];
+    if (node.isLeaf()) {
+      leaves++;
+      depth = max(depth, depths[i]);
       continue;
     }
-    for (auto feature : features)
-      sortedFeatures.push_back(feature);
+    depths[node.children[0]] = depths[node.children[1]] = depths[i] + 1;
   }
   printf("***************\n");
-  for (auto feature : sortedFeatures) {
-    printf("feature '%s' gini %lf\n", feature.c_str(),
-           featureImpurity[feature]);
-  }
-  tree = createNode(0);
-//printf("***************\n");
-//printNode(tree);
-
+  printf("tree: %d nodes, %d leaves, depth %d (max depth %d, min samples per leaf %d, %d threads)\n",
+         int(tree.nodes.size()), leaves, depth, treeParams.maxDepth, treeParams.minSamplesLeaf, pool.size());
 }
 
 void train() {
-
-//  for (auto &row : datapoints) {
-//    for (auto feature : features)
-//      printf("%s:%s", feature.c_str(), row[feature].c_str());
-//    printf("\n");
-//  }
   printf("***************\n");
   vector<string> path;
-  for (auto &row : datapoints) {
+  int corrects = 0;
+  for (int row = 0; row < dataset.rows; row++) {
     path.clear();
-    walkNodes(tree, row, path);
+    bool label = classify([&](int feature) {
+      return DecisionTree::value(dataset, feature, row);
+    }, path);
     for (auto step : path)
       printf("%s ", step.c_str());
-    printf("| (%s)\n", row["Label"].c_str());
+    printf("| (%s)\n", dataset.label(row) ? "Yes" : "No");
+    corrects += label == dataset.label(row);
   }
+  printf("training accuracy: %d of %d\n", corrects, dataset.rows);
 
   printf("***************\n");
-  //printNode(tree);
 }
 
-int test() {
-  auto sample = testSample();
-  unordered_map<string, string> datapoint;
-  datapoint["Age"] = featureBins["Age"].bin(get<0>(sample));
-  datapoint["Income"] = featureBins["Income"].bin(get<1>(sample));
-  datapoint["Education"] = get<2>(sample);
-  datapoint["Marital Status"] = get<3>(sample);
-  datapoint["Occupation"] = get<4>(sample);
-  datapoint["Label"] = get<5>(sample);
+// a generated sample as classify() reads it: numbers for numeric columns, codes for the others
+vector<double> encode(const Sample &sample) {
+  vector<double> values(dataset.columns.size(), -1.0);
+  auto number = [&](string_view feature, double value) {
+    int column = dataset.column(feature);
+    if (column >= 0)
+      values[column] = value;
+  };
+  auto category = [&](string_view feature, string_view value) {
+    int column = dataset.column(feature);
+    if (column >= 0)
+      values[column] = dataset.columns[column].find(value);
+  };
+  number("Age", get<0>(sample));
+  number("Income", get<1>(sample));
+  category("Education", get<2>(sample));
+  category("Marital Status", get<3>(sample));
+  category("Occupation", get<4>(sample));
+  return values;
+}
+
+int test(const Sample &sample) {
+  auto values = encode(sample);
   vector<string> path;
-  auto label = classify(tree, datapoint, path);
+  bool label = classify([&](int feature) {
+    return values[feature];
+  }, path);
   for (auto step : path)
     printf("%s ", step.c_str());
-  bool correct = label == datapoint["Label"];
+  bool correct = label == (get<5>(sample) == "Yes");
   printf("%s\n", correct ? "" : " - X");
   return correct;
+}
+
+// the forest's score on its own training rows (in one batch), out of bag, and on the test samples
+void testForest(const vector<Sample> &samples) {
+  forest.build(dataset, forestParams, pool);
+  printf("***************\n");
+  printf("forest: %d trees, out of bag accuracy %.4lf over %d rows\n", int(forest.trees.size()), forest.oobAccuracy,
+         forest.oobRows);
+
+  vector<int> rows(dataset.rows);
+  for (int i = 0; i < dataset.rows; i++)
+    rows[i] = i;
+  vector<double> probabilities(dataset.rows);
+  forest.predict(dataset, rows.data(), dataset.rows, probabilities.data(), pool);
+  int corrects = 0;
+  for (int i = 0; i < dataset.rows; i++)
+    corrects += (probabilities[i] >= 0.5) == dataset.label(i);
+  printf("forest training accuracy: %d of %d\n", corrects, dataset.rows);
+
+  corrects = 0;
+  for (auto &sample : samples) {
+    auto values = encode(sample);
+    double p = forest.probability(dataset, [&](int feature) {
+      return values[feature];
+    });
+    corrects += (p >= 0.5) == (get<5>(sample) == "Yes");
+  }
+  printf("forest accuracy: %d of %d (%.4lf)\n", corrects, int(samples.size()),
+         double(corrects) / double(samples.size()));
+}
 
+// boosted trees: training loss and accuracy, then the test samples
+void testBoosting(const vector<Sample> &samples) {
+  boosting.build(dataset, boostParams, &pool);
+  printf("***************\n");
+  int corrects = 0;
+  for (int i = 0; i < dataset.rows; i++) {
+    double p = boosting.probability(dataset, [&](int feature) {
+      return DecisionTree::value(dataset, feature, i);
+    });
+    corrects += (p >= 0.5) == dataset.label(i);
+  }
+  printf("boosting: %d rounds, log loss %.4lf, training accuracy: %d of %d\n", int(boosting.trees.size()),
+         boosting.loss(dataset), corrects, dataset.rows);
+
+  corrects = 0;
+  for (auto &sample : samples) {
+    auto values = encode(sample);
+    double p = boosting.probability(dataset, [&](int feature) {
+      return values[feature];
+    });
+    corrects += (p >= 0.5) == (get<5>(sample) == "Yes");
+  }
+  printf("boosting accuracy: %d of %d (%.4lf)\n", corrects, int(samples.size()),
+         double(corrects) / double(samples.size()));
 }
 
 int main() {
@@ -378,18 +324,23 @@ int main() {
 
   FILE *fp = fopen("tree.txt", "w");
   if (fp) {
-    printNodes(tree, 0, fp);
+    printNodes(0, 0, fp);
     fclose(fp);
   }
 
   int numTests = 100;
   int numCorrects = 0;
+  vector<Sample> samples;
   for (int i = 0; i < numTests; i++)
-    numCorrects += test();
+    samples.push_back(testSample());
+  for (auto &sample : samples)
+    numCorrects += test(sample);
   printf("accuracy: %d of %d (%.4lf)\n", numCorrects, numTests,
          double(numCorrects) / double(numTests));
 
+  testForest(samples);
+  testBoosting(samples);
+
   printf("goodbye!\n");
   return 0;
 }
-
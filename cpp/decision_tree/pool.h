@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// work-stealing task pool: every worker keeps its own deque, runs its newest task first (depth first, the
+// data is still in cache) and steals the oldest task of another worker (the biggest piece left) when it
+// runs dry. A thread waiting on a group runs tasks until the group is done, so tasks can wait on tasks.
+struct TaskPool {
+  struct Group {
+    atomic<int> pending { 0 };
+  };
+
+  explicit TaskPool(int threads = int(max(1u, thread::hardware_concurrency()))) {
+    threads = max(1, threads);
+    for (int i = 0; i < threads; i++)
+      queues.push_back(make_unique<Queue>());
+    for (int i = 0; i < threads; i++)
+      workers.emplace_back([this, i]() {
+        work(i);
+      });
+  }
+
+  ~TaskPool() {
+    {
+      lock_guard<mutex> lock(sleepLock);
+      stop = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers)
+      worker.join();
+  }
+
+  TaskPool(const TaskPool&) = delete;
+  TaskPool& operator =(const TaskPool&) = delete;
+
+  int size() const {
+    return int(workers.size());
+  }
+
+  void run(Group &group, function<void()> task) {
+    group.pending++;
+    int self = current(), index = self >= 0 ? self : int(next++ % queues.size());
+    {
+      lock_guard<mutex> lock(queues[index]->lock);
+      queues[index]->tasks.push_back(Task { std::move(task), &group });
+    }
+    {
+      lock_guard<mutex> lock(sleepLock);
+      queued++;
+    }
+    wake.notify_one();
+  }
+
+  void wait(Group &group) {
+    int self = current();
+    while (group.pending > 0)
+      if (!runOne(self))
+        this_thread::yield();
+  }
+
+private:
+  struct Task {
+    function<void()> run;
+    Group *group;
+  };
+
+  struct Queue {
+    mutex lock;
+    deque<Task> tasks;
+  };
+
+  vector<unique_ptr<Queue>> queues;
+  vector<thread> workers;
+  atomic<unsigned> next { 0 };
+  mutex sleepLock;
+  condition_variable wake;
+  int queued = 0;  // tasks in all the deques, under sleepLock
+  bool stop = false;
+
+  // this thread's worker index in this pool, -1 for any other thread
+  int current() const {
+    for (int i = 0; i < int(workers.size()); i++)
+      if (workers[i].get_id() == this_thread::get_id())
+        return i;
+    return -1;
+  }
+
+  bool take(int index, bool newest, Task &task) {
+    lock_guard<mutex> lock(queues[index]->lock);
+    auto &tasks = queues[index]->tasks;
+    if (tasks.empty())
+      return false;
+    if (newest) {
+      task = std::move(tasks.back());
+      tasks.pop_back();
+    } else {
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    return true;
+  }
+
+  bool runOne(int self) {
+    Task task;
+    int count = int(queues.size());
+    bool found = self >= 0 && take(self, true, task);
+    for (int i = 1; !found && i <= count; i++)
+      found = take((max(self, 0) + i) % count, false, task);
+    if (!found)
+      return false;
+    {
+      lock_guard<mutex> lock(sleepLock);
+      queued--;
+    }
+    task.run();
+    task.group->pending--;
+    return true;
+  }
+
+  void work(int self) {
+    for (;;) {
+      if (runOne(self))
+        continue;
+      unique_lock<mutex> lock(sleepLock);
+      wake.wait(lock, [this]() {
+        return stop || queued > 0;
+      });
+      if (stop)
+        return;
+    }
+  }
+};
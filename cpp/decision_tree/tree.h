@@ -0,0 +1,315 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "dataset.h"
+#include "pool.h"
+
+using namespace std;
+
+// CART on a Dataset: every node searches all features for the split that lowers gini the most on the
+// rows that reach it. Rows live in one index array, each split partitions its node's range in place.
+// With a TaskPool, big nodes search their features in parallel and big subtrees grow as tasks of their own;
+// the tree comes out the same as a serial build.
+
+struct TreeParams {
+  int maxDepth = 8;        // the root is depth 0
+  int minSamplesLeaf = 5;  // rows each side of a split keeps at least
+  int parallelRows = 4096; // smaller nodes do all their work, subtree included, on one thread
+  int maxFeatures = 0;     // features a node searches, a random subset; 0 for all of them
+  uint64_t seed = 0;       // draws the subsets, each node's from its place in the rows so threads don't matter
+};
+
+struct TreeNode {
+  int feature = -1;           // split column, -1 for a leaf
+  double threshold = 0.0;     // numeric split: a number <= threshold goes left
+  vector<signed char> sides;  // categorical split, per code: 0 left, 1 right, -1 no row here had it
+  int unknown = 0;            // side for a code the split never saw, the one more rows went to
+  int children[2] = { -1, -1 };
+  int yes = 0;                // training rows that reached the node
+  int no = 0;
+
+  bool isLeaf() const {
+    return feature < 0;
+  }
+
+  bool label() const {
+    return yes >= no;
+  }
+};
+
+inline double gini(int yes, int no) {
+  int total = yes + no;
+  if (0 == total)
+    return 0.0;
+  double p = double(yes) / double(total);
+  double p2 = double(no) / double(total);
+  return 1.0 - (p * p + p2 * p2);
+}
+
+struct DecisionTree {
+  vector<TreeNode> nodes;  // nodes[0] is the root
+  TreeParams params;
+
+  // rows are the training rows' indexes, reordered by the partitioning; pool may be null
+  void build(const Dataset &dataset, vector<int> &rows, const TreeParams &params_, TaskPool *pool = nullptr) {
+    params = params_;
+    nodes.clear();
+    if (rows.empty())
+      return;
+    Build build(dataset, pool, rows.data());
+    build.arenas.push_back(make_unique<vector<TreeNode>>());
+    grow(build, *build.arenas[0], rows.data(), int(rows.size()), 0);
+    if (pool)
+      pool->wait(build.subtrees);
+    flatten(build, *build.arenas[0], 0);
+  }
+
+  // side of a split for one point: value(feature) is its number in a numeric column, its code otherwise
+  template <class Value>
+  int side(const TreeNode &node, const Dataset &dataset, Value value) const {
+    if (dataset.columns[node.feature].numeric)
+      return value(node.feature) <= node.threshold ? 0 : 1;
+    int code = int(value(node.feature));
+    if (code < 0 || code >= int(node.sides.size()) || node.sides[code] < 0)
+      return node.unknown;
+    return node.sides[code];
+  }
+
+  template <class Value>
+  const TreeNode& leaf(const Dataset &dataset, Value value) const {
+    const TreeNode *node = &nodes[0];
+    while (!node->isLeaf())
+      node = &nodes[node->children[side(*node, dataset, value)]];
+    return *node;
+  }
+
+  const TreeNode& leaf(const Dataset &dataset, int row) const {
+    return leaf(dataset, [&](int feature) {
+      return value(dataset, feature, row);
+    });
+  }
+
+  static double value(const Dataset &dataset, int feature, int row) {
+    const auto &column = dataset.columns[feature];
+    return column.numeric ? column.numbers[row] : double(column.codes[row]);
+  }
+
+  // splitmix64 step
+  static uint64_t mix(uint64_t &state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+private:
+  struct Split {
+    int feature = -1;
+    double impurity = 0.0;  // weighted over both sides
+    double threshold = 0.0;
+    vector<signed char> sides;
+  };
+
+  // a subtree grown as a task fills an arena of its own, so no two threads append to one vector;
+  // a child link -(arena + 1) points at another arena's root until flatten() joins them
+  struct Build {
+    const Dataset &dataset;
+    TaskPool *pool;
+    const int *rows;  // start of the whole index array
+    TaskPool::Group subtrees;
+    mutex lock;  // guards arenas
+    vector<unique_ptr<vector<TreeNode>>> arenas;
+
+    Build(const Dataset &dataset_, TaskPool *pool_, const int *rows_)
+        :
+        dataset(dataset_),
+        pool(pool_),
+        rows(rows_) {
+    }
+  };
+
+  int grow(Build &build, vector<TreeNode> &arena, int *rows, int count, int depth) {
+    const Dataset &dataset = build.dataset;
+    int index = int(arena.size());
+    arena.push_back(TreeNode());
+    int yes = 0;
+    for (int i = 0; i < count; i++)
+      yes += dataset.label(rows[i]);
+    arena[index].yes = yes;
+    arena[index].no = count - yes;
+
+    if (depth >= params.maxDepth || count < 2 * params.minSamplesLeaf || 0 == yes || count == yes)
+      return index;
+    // every feature searches on its own, the earliest of the lowest impurities wins as a serial search picks it
+    int features = int(dataset.columns.size());
+    vector<int> candidates = candidateFeatures(int(rows - build.rows), count, features);
+    vector<Split> splits(features);
+    auto search = [&, rows, count](int feature) {
+      splits[feature].impurity = gini(yes, count - yes) - 1e-12;  // a split has to improve on the node
+      if (dataset.columns[feature].numeric)
+        searchNumeric(dataset, feature, rows, count, splits[feature]);
+      else
+        searchCategorical(dataset, feature, rows, count, splits[feature]);
+    };
+    bool parallel = build.pool && count >= params.parallelRows;
+    if (parallel && candidates.size() > 1) {
+      TaskPool::Group group;
+      for (int feature : candidates)
+        build.pool->run(group, [&search, feature]() {
+          search(feature);
+        });
+      build.pool->wait(group);
+    } else
+      for (int feature : candidates)
+        search(feature);
+    int best = -1;
+    for (int feature : candidates)
+      if (splits[feature].feature >= 0 && (best < 0 || splits[feature].impurity < splits[best].impurity))
+        best = feature;
+    if (best < 0)
+      return index;
+
+    TreeNode &node = arena[index];
+    node.feature = best;
+    node.threshold = splits[best].threshold;
+    node.sides = std::move(splits[best].sides);
+    int *middle = std::partition(rows, rows + count, [&](int row) {
+      return 0 == side(node, dataset, [&](int feature) {
+        return value(dataset, feature, row);
+      });
+    });
+    int left = int(middle - rows);
+    node.unknown = left >= count - left ? 0 : 1;
+
+    int *childRows[2] = { rows, middle };
+    int childCounts[2] = { left, count - left };
+    for (int side = 0; side < 2; side++) {
+      if (!build.pool || childCounts[side] < params.parallelRows) {
+        int child = grow(build, arena, childRows[side], childCounts[side], depth + 1);
+        arena[index].children[side] = child;
+        continue;
+      }
+      vector<TreeNode> *subtree;
+      {
+        lock_guard<mutex> lock(build.lock);
+        build.arenas.push_back(make_unique<vector<TreeNode>>());
+        subtree = build.arenas.back().get();
+        arena[index].children[side] = -int(build.arenas.size());
+      }
+      build.pool->run(build.subtrees, [this, &build, subtree, rows = childRows[side], count = childCounts[side], depth]() {
+        grow(build, *subtree, rows, count, depth + 1);
+      });
+    }
+    return index;
+  }
+
+  // all features, or params.maxFeatures of them in column order; a node is known by its range of the rows
+  vector<int> candidateFeatures(int offset, int count, int features) const {
+    vector<int> candidates(features);
+    for (int i = 0; i < features; i++)
+      candidates[i] = i;
+    if (params.maxFeatures <= 0 || params.maxFeatures >= features)
+      return candidates;
+    uint64_t state = params.seed ^ (uint64_t(offset) << 32) ^ uint64_t(count);
+    for (int i = 0; i < params.maxFeatures; i++)
+      swap(candidates[i], candidates[i + int(mix(state) % uint64_t(features - i))]);
+    candidates.resize(params.maxFeatures);
+    sort(candidates.begin(), candidates.end());
+    return candidates;
+  }
+
+  // copies the arenas into nodes in the order a serial build appends them: each node, then its left
+  // subtree, then its right one
+  int flatten(Build &build, vector<TreeNode> &arena, int index) {
+    int at = int(nodes.size());
+    nodes.push_back(std::move(arena[index]));
+    if (nodes[at].isLeaf())
+      return at;
+    for (int side = 0; side < 2; side++) {
+      int child = nodes[at].children[side];
+      child = child >= 0 ? flatten(build, arena, child) : flatten(build, *build.arenas[-child - 1], 0);
+      nodes[at].children[side] = child;
+    }
+    return at;
+  }
+
+  // sorted by value, every boundary between distinct values is a candidate threshold
+  void searchNumeric(const Dataset &dataset, int feature, const int *rows, int count, Split &best) const {
+    const auto &numbers = dataset.columns[feature].numbers;
+    vector<pair<double, int>> sorted(count);
+    int yes = 0;
+    for (int i = 0; i < count; i++) {
+      sorted[i] = { numbers[rows[i]], int(dataset.label(rows[i])) };
+      yes += sorted[i].second;
+    }
+    sort(sorted.begin(), sorted.end());
+    int leftYes = 0;
+    for (int i = 0; i < count - 1; i++) {
+      leftYes += sorted[i].second;
+      if (sorted[i].first == sorted[i + 1].first)
+        continue;
+      int left = i + 1, right = count - left;
+      if (left < params.minSamplesLeaf || right < params.minSamplesLeaf)
+        continue;
+      double impurity = (left * gini(leftYes, left - leftYes) + right * gini(yes - leftYes, right - (yes - leftYes))) / count;
+      if (impurity < best.impurity) {
+        best.feature = feature;
+        best.impurity = impurity;
+        best.threshold = 0.5 * (sorted[i].first + sorted[i + 1].first);
+        best.sides.clear();
+      }
+    }
+  }
+
+  // the node's (code x label) histogram; codes ordered by their share of yes, the best split of a
+  // two class label is one of the prefixes of that order (Breiman et al.)
+  void searchCategorical(const Dataset &dataset, int feature, const int *rows, int count, Split &best) const {
+    const auto &column = dataset.columns[feature];
+    int cardinality = column.cardinality();
+    vector<int> counts(cardinality * 2);
+    for (int i = 0; i < count; i++)
+      counts[column.codes[rows[i]] * 2 + int(dataset.label(rows[i]))]++;
+
+    vector<int> present;
+    int yes = 0;
+    for (int code = 0; code < cardinality; code++) {
+      if (counts[code * 2] + counts[code * 2 + 1] > 0)
+        present.push_back(code);
+      yes += counts[code * 2 + 1];
+    }
+    if (present.size() < 2)
+      return;
+    sort(present.begin(), present.end(), [&](int a, int b) {
+      // ys_a / total_a < ys_b / total_b without dividing
+      return double(counts[a * 2 + 1]) * (counts[b * 2] + counts[b * 2 + 1])
+          < double(counts[b * 2 + 1]) * (counts[a * 2] + counts[a * 2 + 1]);
+    });
+
+    int left = 0, leftYes = 0, bestPrefix = -1;
+    for (int k = 0; k < int(present.size()) - 1; k++) {
+      int code = present[k];
+      left += counts[code * 2] + counts[code * 2 + 1];
+      leftYes += counts[code * 2 + 1];
+      int right = count - left;
+      if (left < params.minSamplesLeaf || right < params.minSamplesLeaf)
+        continue;
+      double impurity = (left * gini(leftYes, left - leftYes) + right * gini(yes - leftYes, right - (yes - leftYes))) / count;
+      if (impurity < best.impurity) {
+        best.feature = feature;
+        best.impurity = impurity;
+        bestPrefix = k;
+      }
+    }
+    if (bestPrefix < 0)
+      return;
+    best.sides.assign(cardinality, -1);
+    for (int k = 0; k < int(present.size()); k++)
+      best.sides[present[k]] = k <= bestPrefix ? 0 : 1;
+  }
+};
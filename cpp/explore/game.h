@@ -5,7 +5,13 @@ using namespace sdl2;
 
 #include "vector.h"
 #include "reinforce.h"
+#include "gym.h"
 #include <optional>
+#include <string>
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define PI 3.14159265358979
 
@@ -47,6 +53,37 @@ void initDirections() {
 
 }
 
+// one bit per cell in 8x8 tiles, a cell and its neighbours almost always share a word; set and get are relaxed
+// atomics so actor threads marking cells of one shared grid never drop each other's bits
+struct BitGrid {
+  int w = 0, h = 0, tw = 0;
+  std::vector<uint64_t> tiles;
+
+  void init(int w_, int h_) {
+    w = w_;
+    h = h_;
+    tw = (w + 7) >> 3;
+    tiles = std::vector<uint64_t>(size_t(tw) * ((h + 7) >> 3));
+  }
+
+  // cells outside the grid read as clear, without branching
+  bool get(int x, int y) const {
+    bool inside = ((unsigned) x < (unsigned) w) & ((unsigned) y < (unsigned) h);
+    int cx = inside ? x : 0, cy = inside ? y : 0;
+    uint64_t tile = __atomic_load_n(&tiles[(cy >> 3) * tw + (cx >> 3)], __ATOMIC_RELAXED);
+    return inside & (tile >> (((cy & 7) << 3) | (cx & 7))) & 1;
+  }
+
+  void set(int x, int y) {
+    __atomic_fetch_or(&tiles[(y >> 3) * tw + (x >> 3)], uint64_t(1) << (((y & 7) << 3) | (x & 7)), __ATOMIC_RELAXED);
+  }
+
+  void clear() {
+    for (auto &tile : tiles)
+      __atomic_store_n(&tile, 0, __ATOMIC_RELAXED);
+  }
+};
+
 struct Game {
 
   Game() {
@@ -57,19 +94,20 @@ struct Game {
   struct Map {
     int w = 0, h = 0;
     double downscale = 0.0f;
-    std::vector<int> points;
+    BitGrid open;  // walkable cells
     Vector2 origin;
     Vector2 target;
 
     std::vector<Pixel24> colors;
-    std::vector<int> visits;
+    BitGrid visits;  // written by every explorer, only ever drawn
+    std::vector<float> clearance;  // distance from each cell to the nearest blocked one, the border counts as blocked
     void init(std::string_view file) {
       Bitmap bitmap(file.data());
       w = bitmap.width();
       h = bitmap.height();
-      points = std::vector<int>(w * h);
+      open.init(w, h);
       colors = std::vector<Pixel24>(w * h);
-      visits = std::vector<int>(w * h);
+      visits.init(w, h);
 
       bitmap.lock();
       auto &pixels = bitmap.pixels;
@@ -77,7 +115,8 @@ struct Game {
       for (int y = 0; y < h; y++)
         for (int x = 0; x < w; x++) {
           auto pix = *pixels.get24(x, y);
-          points[y * w + x] = isBlack(pix) ? 0 : 1;
+          if (!isBlack(pix))
+            open.set(x, y);
           if (isRed(pix)) {
             tot++;
             origin = origin + Vector2(x, y);
@@ -90,6 +129,7 @@ struct Game {
         }
       bitmap.unlock();
       downscale = 1.0 / radius();
+      buildClearance();
 
       origin = origin * (1.0 / tot);
       target = target * (1.0 / tot2);
@@ -98,6 +138,64 @@ struct Game {
       printf("target.: { %d, %d }\n", int(target.x), int(target.y));
 
     }
+    // exact squared euclidean distance transform of one row or column (Felzenszwalb & Huttenlocher)
+    static void distanceTransform(const double *f, int n, double *d, int *v, double *z) {
+      const double inf = 1e20;
+      int k = 0;
+      v[0] = 0;
+      z[0] = -inf;
+      z[1] = +inf;
+      for (int q = 1; q < n; q++) {
+        double s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0 * (q - v[k]));
+        while (s <= z[k]) {
+          k--;
+          s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0 * (q - v[k]));
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = +inf;
+      }
+      k = 0;
+      for (int q = 0; q < n; q++) {
+        while (z[k + 1] < q)
+          k++;
+        d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+      }
+    }
+
+    void buildClearance() {
+      // padded by one blocked cell on every side so the map edge stops rays like a wall
+      int pw = w + 2, ph = h + 2, n = pw > ph ? pw : ph;
+      std::vector<double> grid(pw * ph), f(n), d(n), z(n + 1);
+      std::vector<int> v(n);
+      for (int y = 0; y < ph; y++)
+        for (int x = 0; x < pw; x++) {
+          bool blocked = x == 0 || y == 0 || x == pw - 1 || y == ph - 1 || !open.get(x - 1, y - 1);
+          grid[y * pw + x] = blocked ? 0.0 : 1e20;
+        }
+      for (int x = 0; x < pw; x++) {
+        for (int y = 0; y < ph; y++)
+          f[y] = grid[y * pw + x];
+        distanceTransform(f.data(), ph, d.data(), v.data(), z.data());
+        for (int y = 0; y < ph; y++)
+          grid[y * pw + x] = d[y];
+      }
+      clearance = std::vector<float>(w * h);
+      for (int y = 0; y < ph; y++) {
+        distanceTransform(&grid[y * pw], pw, d.data(), v.data(), z.data());
+        if (y > 0 && y < ph - 1)
+          for (int x = 1; x < pw - 1; x++)
+            clearance[(y - 1) * w + (x - 1)] = (float) sqrt(d[x]);
+      }
+    }
+
+    float clearanceAt(int x, int y) {
+      if (x < 0 || x >= w || y < 0 || y >= h)
+        return 0.0f;
+      return clearance[y * w + x];
+    }
+
     double radiusSq() {
       return double(w * w + h * h);
     }
@@ -105,16 +203,14 @@ struct Game {
       return sqrt(radiusSq());
     }
 
-    bool oob(int x, int y) {
-      if (x < 0 || x >= w || y < 0 || y >= h)
-        return true;
-      return points[y * w + x] == 0;
+    bool oob(int x, int y) const {
+      return !open.get(x, y);
     }
 
-    int& get(int x, int y) {
+    bool get(int x, int y) {
       CLAMP(x, 0, w - 1);
       CLAMP(y, 0, h - 1);
-      return points[y * w + x];
+      return open.get(x, y);
     }
 
     float traceLine(Vector2 p, Vector2 p2) {
@@ -125,10 +221,9 @@ struct Game {
       if (0 == dist)
         return 1.0f;
 
-      float alpha = 0.0f, alpha2 = 0.0f;
+      int probe = 0;  // samples until the clearance is consulted again
       for (int d = 0; d <= dist; d++) {
-        alpha = alpha2;
-        alpha2 = float(d) / float(dist);
+        float alpha2 = float(d) / float(dist);
         Vector2 u = LERP(p, p2, alpha2);
 
         int x = (int) u.x;
@@ -137,11 +232,104 @@ struct Game {
         int y2 = u.y > y ? y + 1 : u.y < y ? y - 1 : y;
 
         if (oob(x, y) || oob(x2, y) || oob(x, y2) || oob(x2, y2))
-          return alpha;
+          return d > 0 ? float(d - 1) / float(dist) : 0.0f;  // last clear sample
+
+        // samples are at most sqrt(2) apart and probe the cells next to them, so the
+        // ones the clearance keeps away from every wall can be skipped untested
+        if (--probe > 0)
+          continue;
+        int skip = int(clearanceAt(x, y) * 0.70710678f) - 3;
+        if (skip > 0)
+          d += skip;
+        else
+          probe = 4;  // close to a wall, plain stepping for a while
       }
       return 1.0;
     }
 
+    // traceLine for several rays from one origin, four rays marched in lockstep per SSE2 register
+    void traceLines(Vector2 p, const Vector2 *p2, int count, float *alphas) {
+#if defined(__SSE2__)
+      for (int base = 0; base < count; base += 4) {
+        int n = count - base < 4 ? count - base : 4;
+        alignas(16) float ex[4], ey[4], dists[4];
+        int alive[4] = { 0, 0, 0, 0 };
+        int longest = 0;
+        for (int i = 0; i < 4; i++) {
+          Vector2 e = p2[base + (i < n ? i : 0)];
+          int dx = abs(e.x - p.x);
+          int dy = abs(e.y - p.y);
+          int dist = dx > dy ? dx : dy;
+          ex[i] = e.x;
+          ey[i] = e.y;
+          dists[i] = dist ? dist : 1;
+          if (i >= n)
+            continue;
+          alphas[base + i] = 1.0f;
+          if (0 == dist)
+            continue;
+          alive[i] = 1;
+          longest = dist > longest ? dist : longest;
+        }
+        __m128 px = _mm_set1_ps(p.x), py = _mm_set1_ps(p.y);
+        __m128 qx = _mm_load_ps(ex), qy = _mm_load_ps(ey), qd = _mm_load_ps(dists);
+        int probe = 0;
+        for (int d = 0; d <= longest; d++) {
+          // LERP rounds to float at every Vector2 it builds, so float lanes give the same samples
+          __m128 a = _mm_div_ps(_mm_set1_ps(float(d)), qd);
+          __m128 b = _mm_sub_ps(_mm_set1_ps(1.0f), a);
+          __m128 ux = _mm_add_ps(_mm_mul_ps(b, px), _mm_mul_ps(a, qx));
+          __m128 uy = _mm_add_ps(_mm_mul_ps(b, py), _mm_mul_ps(a, qy));
+          __m128i x = _mm_cvttps_epi32(ux), y = _mm_cvttps_epi32(uy);
+          __m128 fx = _mm_cvtepi32_ps(x), fy = _mm_cvtepi32_ps(y);
+          // compare masks are -1, so subtracting "above" and adding "below" steps one cell out
+          __m128i x2 = _mm_add_epi32(_mm_sub_epi32(x, _mm_castps_si128(_mm_cmpgt_ps(ux, fx))), _mm_castps_si128(_mm_cmplt_ps(ux, fx)));
+          __m128i y2 = _mm_add_epi32(_mm_sub_epi32(y, _mm_castps_si128(_mm_cmpgt_ps(uy, fy))), _mm_castps_si128(_mm_cmplt_ps(uy, fy)));
+          alignas(16) int xs[4], ys[4], x2s[4], y2s[4];
+          _mm_store_si128((__m128i*) xs, x);
+          _mm_store_si128((__m128i*) ys, y);
+          _mm_store_si128((__m128i*) x2s, x2);
+          _mm_store_si128((__m128i*) y2s, y2);
+          int any = 0;
+          for (int i = 0; i < n; i++) {
+            if (!alive[i])
+              continue;
+            if (d > (int) dists[i]) {
+              alive[i] = 0;
+              continue;
+            }
+            if (oob(xs[i], ys[i]) | oob(x2s[i], ys[i]) | oob(xs[i], y2s[i]) | oob(x2s[i], y2s[i])) {
+              alphas[base + i] = d > 0 ? float(d - 1) / dists[i] : 0.0f;
+              alive[i] = 0;
+              continue;
+            }
+            any = 1;
+          }
+          if (!any)
+            break;
+
+          // the shortest skip any live ray could take is safe for all of them
+          if (--probe > 0)
+            continue;
+          int skip = longest;
+          for (int i = 0; i < n; i++) {
+            if (!alive[i])
+              continue;
+            int s = int(clearanceAt(xs[i], ys[i]) * 0.70710678f) - 3;
+            skip = s < skip ? s : skip;
+          }
+          if (skip > 0)
+            d += skip;
+          else
+            probe = 4;
+        }
+      }
+#else
+      for (int i = 0; i < count; i++)
+        alphas[i] = traceLine(p, p2[i]);
+#endif
+    }
+
     float traceDist(Vector2 p, Vector2 d) {
       // modified Bresenham
       Vector2 p2 = p + radius() * d;
@@ -158,27 +346,28 @@ struct Game {
     void visit(int x, int y) {
       CLAMP(x, 0, w - 1);
       CLAMP(y, 0, h - 1);
-      visits[y * w + x] = 1;
+      visits.set(x, y);
     }
     bool visited(int x, int y) {
       CLAMP(x, 0, w - 1);
       CLAMP(y, 0, h - 1);
-      return visits[y * w + x] == 1;
+      return visits.get(x, y);
     }
 
     void clearVisited() {
-      for (auto &v : visits)
-        v = 0;
+      visits.clear();
     }
   };
 
   struct Agent {
     static constexpr double maxDist = 8.0;
+    static constexpr int episodeLength = 2000;  // gym episodes end here, or on reaching the target
 
     Map *map;
 
     Vector2 p;  // position
     int action;  // direction
+    int episodeSteps = 0;
 
     void init(Map &map_) {
       map = &map_;
@@ -201,6 +390,25 @@ struct Game {
       map->visit(p.x, p.y);
     }
 
+    // gym.h environment: the same observation, move and reward as the RL callbacks, plus episode ends
+    void reset(double *observation) {
+      reset();
+      episodeSteps = 0;
+      nnSetup(observation);
+    }
+
+    GymStep step(int action_, double *observation) {
+      action = action_;
+      if (!traceHit())
+        step();
+      double reward = avoidReward();
+      Vector2 d = p.point(map->target);
+      bool done = d.dot(d) < 4.0;
+      bool truncated = ++episodeSteps >= episodeLength && !done;  // out of time, not a terminal state
+      nnSetup(observation);
+      return GymStep { reward, done, truncated };
+    }
+
     double simpleReward() {
       //use with test map
       Vector2 d = map->target - p;
@@ -254,9 +462,14 @@ struct Game {
       inputs[k++] = map->target.x * map->downscale;
       inputs[k++] = map->target.y * map->downscale;
       //inputs[k++] = traceHit();
-      for (auto d : directions) {
-        inputs[k++] = traceHit(d);
-      }
+      Vector2 ends[NN_MAX_NEURONS];
+      float alphas[NN_MAX_NEURONS];
+      int n = (int) directions.size();
+      for (int i = 0; i < n; i++)
+        ends[i] = p + maxDist * directions[i];
+      map->traceLines(p, ends, n, alphas);
+      for (int i = 0; i < n; i++)
+        inputs[k++] = alphas[i] < 1.0;
       return k;
     }
 
@@ -275,6 +488,14 @@ struct Game {
   double gamma = 0.7;   // q learning discount factor
   double epsilon = 0.2;  // epsilon greedy epsilon value
   double alpha = 0.3;  // Bellman learning rate
+  bool recurrent = false;  // recurrent Q-network, gives the explorer memory on partially observed maps
+  int bpttDepth = 8;  // steps of observation history the recurrent Q-network learns from
+  int envCount = 1;  // explorers stepped together through one batched Q-network pass (feed-forward only)
+  int actorThreads = 0;  // > 0 moves stepping and learning off the render thread (feed-forward only)
+  bool training = true;  // false: act greedily on a loaded checkpoint, never learn
+  bool actionInputs = true;  // false: the Q-network sees only the observation, checkpoints of the two layouts don't mix (feed-forward only)
+  bool gym = false;  // step the explorers through Gym<Agent> (gym.h) instead of the RL callbacks (feed-forward only)
+  std::string checkpointFile = "nn.txt";  // training not yet checkpointed is written here on exit
 
   Map map;
   Agent explorer;
@@ -309,6 +530,12 @@ struct Game {
     }
   };
   RL *rl = nullptr;
+  std::vector<Agent> crew;  // explorers beyond the first when envCount > 1
+  std::vector<RL> crewRL;
+  std::vector<RL_agent_state_t> envStates;
+  std::vector<Agent*> gymEnvs;
+  Gym<Agent> *gymRL = nullptr;
+
   void init() {
 
     map.init("map1.bmp");
@@ -326,15 +553,104 @@ struct Game {
     printf("%s:output size: %d\n", __FUNCTION__, info.output_size);
 
     rl = new RL(map, explorer);
-    rl->ai = RL_init(RL_sarsa, alpha, epsilon, gamma, &info, RL::set, RL::reward, RL::act, rl);
+    if (recurrent) {
+      RNN_info_t rinfo = { };
+      rinfo.mode = RNN_seq_to_seq;
+      rinfo.learning_rate = learn;
+      rinfo.beta = 0.9;
+      rinfo.clip_norm = 5.0;
+      rinfo.bptt_depth = bpttDepth;
+      rinfo.hidden_layers_size = 1;
+      rinfo.neurons_per[0] = 64;
+      rinfo.input_size = info.input_size;
+      rinfo.output_size = info.output_size;
+      rl->ai = RL_init_recurrent(RL_sarsa, alpha, epsilon, gamma, &rinfo, RL::set, RL::reward, RL::act, rl);
+    } else {
+      rl->ai = RL_init(RL_sarsa, alpha, epsilon, gamma, &info, RL::set, RL::reward, RL::act, rl);
+      if (!actionInputs && !RL_drop_action_inputs(rl->ai))
+        actionInputs = true;  // the gym rows must match the network's width
+    }
+
+    if (gym && !recurrent) {
+      gymEnvs.push_back(&explorer);
+      crew.resize(envCount - 1);
+      for (auto &agent : crew) {
+        agent.init(map);
+        gymEnvs.push_back(&agent);
+      }
+      gymRL = new Gym<Agent>(RL_sarsa, alpha, epsilon, gamma, info, gymEnvs.data(), (int) gymEnvs.size(), actionInputs);
+      return;
+    }
+    if (!recurrent && (envCount > 1 || actorThreads > 0)) {
+      crew.resize(envCount - 1);
+      crewRL.reserve(crew.size());  // envStates points into crewRL
+      envStates.push_back(rl);
+      for (auto &agent : crew) {
+        agent.init(map);
+        crewRL.emplace_back(map, agent);
+        envStates.push_back(&crewRL.back());
+      }
+    }
+    if (training && !recurrent && actorThreads > 0) {
+      // explorers now move on actor threads, drawing only reads their positions and visit marks
+      RL_enable_replay(rl->ai, 1 << 16, 32, RL_true);
+      RL_enable_target_network(rl->ai, 100, RL_true);
+      startActors();
+    }
+  }
+
+  void startActors() {
+    unsaved |= RL_start_actors(rl->ai, envStates.data(), (int) envStates.size(), actorThreads, 10);
+  }
+
+  long actorSteps = 0;  // steps of actor threads already stopped
+  bool unsaved = false;  // learning happened since the last checkpoint
+
+  // actors are paused while the network is written so the learner never trains mid export;
+  // resume false leaves them stopped, for the last checkpoint of a run
+  void checkpoint(const char *file, bool resume = true) {
+    unsaved = false;
+    if (gymRL)
+      gymRL->save(file);
+    else if (actorThreads > 0) {
+      actorSteps += RL_stop_actors(rl->ai);
+      RL_export_neural_network(rl->ai, file);
+      if (resume)
+        startActors();
+    } else
+      RL_export_neural_network(rl->ai, file);
+  }
+
+  bool load(const char *file) {
+    if (gymRL)
+      return gymRL->load(file);
+    return RL_import_neural_network(rl->ai, file);
   }
 
   void explore() {
-    RL_step(rl->ai);
+    unsaved |= training;
+    if (gymRL) {
+      if (training)
+        gymRL->step();
+      else
+        gymRL->play();
+    } else if (!training)
+      RL_play(rl->ai);
+    else if (recurrent)
+      RL_step_recurrent(rl->ai);
+    else if (envStates.size() > 1)
+      RL_step_vec(rl->ai, envStates.data(), (int) envStates.size(), nullptr);
+    else
+      RL_step(rl->ai);
   }
 
   ~Game() {
-    RL_export_neural_network(rl->ai, "nn.txt");
+    RL_stop_actors(rl->ai);
+    if (unsaved && gymRL)
+      gymRL->save(checkpointFile.c_str());
+    else if (unsaved)
+      RL_export_neural_network(rl->ai, checkpointFile.c_str());
+    delete gymRL;
     RL_term(&rl->ai);
     delete rl;
   }
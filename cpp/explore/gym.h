@@ -0,0 +1,171 @@
+#pragma once
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "reinforce.h"
+
+// Q-learning / SARSA on an environment type known at compile time: the engine calls it directly,
+// no RL_agent_state_t casts and no callback pointers, so reset and step inline into the loop. Only the
+// environment loop lives here: the network, action choice, td target and update are an RL_init agent's
+// (reinforce.h), so both engines learn by the same rule. Replay, target networks and actors run through
+// RL_step / RL_step_vec only, Gym trains online on each step's transitions.
+// An environment provides
+//   void reset(double *observation);                // starts an episode, writes its first observation
+//   GymStep step(int action, double *observation);  // acts, writes the next observation
+// Observations go straight into the engine's input rows, once per step; after a done or truncated step the
+// engine resets the environment, which overwrites the last observation with the next episode's first.
+
+struct GymStep {
+  double reward;
+  bool done;  // the episode reached a terminal state, no value is bootstrapped past this step
+  bool truncated = false;  // the episode was cut short (a time limit): it restarts, but the step still bootstraps
+};
+
+template <class Env>
+struct Gym {
+  RL_agent_t ai = nullptr;
+  Env **envs;
+  int count;
+  long steps = 0;  // environment steps, summed over all environments
+  long episodes = 0;  // episodes finished
+
+  // nn_info.input_size is the observation size, as for RL_init; every buffer is sized here, stepping never allocates.
+  // actionInputs false drops the previous action from the rows, as RL_drop_action_inputs does
+  Gym(RL_type_t type, double alpha, double epsilon, double gamma, const NN_info_t &nn_info, Env **envs_, int count_, bool actionInputs = true)
+      :
+      envs(envs_),
+      count(count_),
+      offset(actionInputs ? 2 : 0) {
+    ai = RL_init(type, alpha, epsilon, gamma, &nn_info, nullptr, nullptr, nullptr, nullptr);
+    if (!actionInputs)
+      RL_drop_action_inputs(ai);
+    width = nn_info.input_size + offset;
+    qcount = nn_info.output_size;
+    inputs.resize(count * width);
+    nextInputs.resize(count * width);
+    qs.resize(count * qcount);
+    nextQs.resize(count * qcount);
+    actions.resize(count);
+    taken.resize(count);
+    rewards.resize(count);
+    dones.resize(count);
+    ends.resize(count);
+    valued.resize(count);
+    for (int k = 0; k < count; k++)
+      begin(k, &inputs[k * width]);
+  }
+
+  ~Gym() {
+    RL_term(&ai);
+  }
+
+  Gym(const Gym&) = delete;
+  Gym& operator =(const Gym&) = delete;
+
+  // every environment takes one action off a batched pass, the transitions train as one mini-batch
+  void step() {
+    valueRows();
+    for (int k = 0; k < count; k++)
+      act(k, RL_choose_action(ai, &qs[k * qcount], RL_true));
+    RL_value_batch(ai, nextInputs.data(), nextQs.data(), count);
+
+    // the rewards become td targets
+    for (int k = 0; k < count; k++)
+      if (!dones[k])
+        rewards[k] = RL_td_target(ai, rewards[k], taken[k], &nextQs[k * qcount]);
+    RL_fit_batch(ai, inputs.data(), taken.data(), rewards.data(), count);
+    // the bootstrap values pick the next actions, one update stale as an actor's snapshot would be
+    qs.swap(nextQs);
+    for (int k = 0; k < count; k++)
+      valued[k] = !ends[k];
+    advance();
+  }
+
+  // greedy actions, no exploration and no learning
+  void play() {
+    std::fill(valued.begin(), valued.end(), 0);
+    RL_value_batch(ai, inputs.data(), qs.data(), count);
+    for (int k = 0; k < count; k++)
+      act(k, RL_choose_action(ai, &qs[k * qcount], RL_false));
+    advance();
+  }
+
+  void save(const char *filename) {
+    RL_export_neural_network(ai, filename);
+  }
+
+  // checkpoint must match the engine's input and output sizes, RL_export_neural_network files load too
+  bool load(const char *filename) {
+    if (!RL_import_neural_network(ai, filename))
+      return false;
+    std::fill(valued.begin(), valued.end(), 0);
+    return true;
+  }
+
+private:
+  int offset;  // observation start in a row, after the last action when it is an input
+  int width;  // input row: the last action, then the observation
+  int qcount;
+  std::vector<double> inputs;  // count x width
+  std::vector<double> nextInputs;
+  std::vector<double> qs;  // count x qcount
+  std::vector<double> nextQs;
+  std::vector<RL_action_t> actions;
+  std::vector<int> taken;  // the actions' indices, as RL_fit_batch takes them
+  std::vector<double> rewards;  // then the td targets
+  std::vector<char> dones;  // terminal steps
+  std::vector<char> ends;  // terminal or truncated, the environment restarts
+  std::vector<char> valued;  // rows whose qs the last step's bootstrap pass already filled
+
+  void begin(int k, double *input) {
+    actions[k] = RL_action_t { 0, RL_true };
+    if (offset) {
+      input[0] = (double) actions[k].exploratory;
+      input[1] = (double) actions[k].taken;
+    }
+    envs[k]->reset(&input[offset]);
+  }
+
+  void act(int k, RL_action_t action) {
+    double *next = &nextInputs[k * width];
+    actions[k] = action;
+    taken[k] = action.taken;
+    if (offset) {
+      next[0] = (double) action.exploratory;
+      next[1] = (double) action.taken;
+    }
+    GymStep result = envs[k]->step(action.taken, &next[offset]);
+    rewards[k] = result.reward;
+    dones[k] = result.done;
+    ends[k] = result.done || result.truncated;
+  }
+
+  // one batched pass for the rows the last step left unvalued, the next rows are free to hold them until acting
+  void valueRows() {
+    int misses = 0;
+    for (int k = 0; k < count; k++) {
+      if (valued[k])
+        continue;
+      memcpy(&nextInputs[misses * width], &inputs[k * width], sizeof(double) * width);
+      misses++;
+    }
+    RL_value_batch(ai, nextInputs.data(), nextQs.data(), misses);
+    for (int k = count - 1; k >= 0; k--)
+      if (!valued[k])
+        memcpy(&qs[k * qcount], &nextQs[--misses * qcount], sizeof(double) * qcount);
+  }
+
+  // finished episodes restart, then the next observations become the current ones
+  void advance() {
+    for (int k = 0; k < count; k++) {
+      if (!ends[k])
+        continue;
+      begin(k, &nextInputs[k * width]);
+      episodes++;
+    }
+    inputs.swap(nextInputs);
+    steps += count;
+  }
+};
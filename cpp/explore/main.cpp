@@ -19,10 +19,20 @@ SDL sdl;
 Game g;
 
 bool paused = false;
+const char *checkpoint = "nn.txt";  // written by the headless trainer (train.cpp)
+
+void load() {
+  if (g.load(checkpoint))
+    printf("loaded checkpoint '%s'\n", checkpoint);
+  else
+    printf("no usable checkpoint '%s', showing an untrained explorer\n", checkpoint);
+}
 
 void init() {
   printf("*** INIT ***\n");
+  g.training = false;  // the viewer only plays back checkpoints
   g.init();
+  load();
   printf("************\n");
 }
 
@@ -40,6 +50,9 @@ void step() {
     g.map.clearVisited();
   }
 
+  if (sdl.keyPress(SDLK_l))
+    load();  // pick up the trainer's latest checkpoint
+
   if (sdl.mouseKeyDown(2)) {
     printf("%d, %d\n", sdl.mouseX, sdl.mouseY);
     g.explorer.reset(Vector2(double(sdl.mouseX), double(sdl.mouseY)));
@@ -67,6 +80,8 @@ void draw() {
       }
   };
 
+  for (auto &agent : g.crew)
+    draw_faded_box(agent.p, 2, agent.color(), 0.6);
   draw_faded_box(g.explorer.p, 4, g.explorer.color(), 1.0);
 //  for (auto d : directions) {
 //    Vector2 p = g.explorer.p;
@@ -84,6 +99,8 @@ void term() {
 
 int main(int argc, char *args[]) {
   setbuf( stdout, NULL);
+  if (argc > 1)
+    checkpoint = args[1];
 
   if (!sdl.init( DISP_W, DISP_H, false, "Dora the Explorer!")) {
     return 0;
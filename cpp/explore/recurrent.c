@@ -0,0 +1,671 @@
+#include "recurrent.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define CLAMP( v, l, h ){ v = v < (l) ? (l) : v > (h) ? (h) : v; }
+
+extern double sigmoid_act(double x);
+extern double sigmoid_deriv(double x);
+extern double tanh_act(double x);
+extern double tanh_deriv(double x);
+extern double relu_act(double x);
+extern double relu_deriv(double x);
+extern double leaky_relu_act(double x, double alpha);
+extern double leaky_relu_deriv(double x, double alpha);
+
+double output_act(double x) {
+  return x;
+  //return sigmoid_act(x);
+}
+
+double output_deriv(double x) {
+  return 1.0;
+  //return sigmoid_deriv(x);
+}
+
+double hidden_act(double x) {
+  return tanh_act(x);
+  //return leaky_relu_act(x, 0.1);
+}
+
+double hidden_deriv(double x) {
+  return tanh_deriv(x);
+  //return leaky_relu_deriv(x, 0.1);
+}
+
+void apply_momentum(double *value, double *moment, double beta, double learning_rate, double grad, double beta_correction_inv) {
+  *moment = beta * (*moment) + (1.0 - beta) * grad;
+  double m0 = *moment * beta_correction_inv;
+  *value -= learning_rate * m0;
+}
+
+static void init_recurrent_neuron(RNN_neuron_t *neuron, int m, int n, int d) {
+  neuron->bias = 0.0;
+
+  double lim = sqrt(6.0 / (double) (m + n));  // Xaviar/Glorot
+  NN_random_fill(neuron->weights, m, 2.0 * lim, -lim);
+
+  lim = sqrt(1.0 / n);  // He
+  NN_random_fill(neuron->recurrent_weights, n, 2.0 * lim, -lim);
+
+  for (int i = 0; i < d; i++)
+    neuron->history[i] = neuron->delta[i] = 0.0;
+  memset(&neuron->moment, 0, sizeof(neuron->moment));
+}
+
+static void init_recurrent_neural_first_hidden_layer(RNN_neural_layer_t *layer, int size, int input_size, const RNN_sequence_t *input, int depth) {
+  layer->type = NN_first;
+  layer->size = size;
+  CLAMP(layer->size, 1, NN_MAX_NEURONS);
+  layer->input = input;
+  for (int i = 0; i < layer->size; i++)
+    init_recurrent_neuron(&layer->neurons[i], input_size, layer->size, depth);
+}
+
+static void init_recurrent_neural_hidden_layer(RNN_neural_layer_t *layer, RNN_neural_layer_t *previous_layer, int size, int depth) {
+  layer->type = NN_hidden;
+  layer->size = size;
+  CLAMP(layer->size, 1, NN_MAX_NEURONS);
+  layer->feed = previous_layer;
+  for (int i = 0; i < layer->size; i++)
+    init_recurrent_neuron(&layer->neurons[i], layer->feed->size, layer->size, depth);
+}
+
+static void init_recurrent_neural_output_layer(RNN_neural_layer_t *layer, RNN_neural_layer_t *previous_layer, int size, int depth) {
+  layer->type = NN_output;
+  layer->size = size;
+  CLAMP(layer->size, 1, NN_MAX_NEURONS);
+  layer->feed = previous_layer;
+  for (int i = 0; i < layer->size; i++)
+    init_recurrent_neuron(&layer->neurons[i], layer->feed->size, layer->size, depth);
+}
+
+static void recurrent_neural_layer_propagate_hidden(RNN_neural_layer_t *layer, int input_size, int now) {
+  int then = (now - 1 + RNN_MAX_DEPTH) % RNN_MAX_DEPTH;
+  for (int i = 0; i < layer->size; i++) {
+    RNN_neuron_t *neuron = &layer->neurons[i];
+    double sum = neuron->bias;
+
+    // input sum
+    if (layer->type == NN_first) {
+      for (int j = 0; j < input_size; j++)
+        sum += neuron->weights[j] * layer->input->values[now][j];
+    } else {
+      for (int j = 0; j < layer->feed->size; j++)
+        sum += neuron->weights[j] * layer->feed->neurons[j].history[now];
+    }
+
+    // recurrent sum
+    for (int j = 0; j < layer->size; j++)
+      sum += neuron->recurrent_weights[j] * layer->neurons[j].history[then];
+
+    neuron->history[now] = hidden_act(sum);
+  }
+}
+
+static void recurrent_neural_layer_propagate_output(RNN_neural_layer_t *layer, int now) {
+  if (layer->type != NN_output)
+    return;
+
+  for (int i = 0; i < layer->size; i++) {
+    RNN_neuron_t *neuron = &layer->neurons[i];
+    double sum = neuron->bias;
+    for (int j = 0; j < layer->feed->size; j++)
+      sum += neuron->weights[j] * layer->feed->neurons[j].history[now];
+    neuron->history[now] = output_act(sum);
+  }
+}
+
+void RNN_init_neural_network(RNN_neural_network_t *rnn, const RNN_info_t *params) {
+  rnn->info.hidden_layers_size = params->hidden_layers_size;
+  CLAMP(rnn->info.hidden_layers_size, 1, NN_MAX_HIDDEN_LAYERS);
+  rnn->info.input_size = params->input_size;
+  CLAMP(rnn->info.input_size, 1, NN_MAX_NEURONS);
+  rnn->info.output_size = params->output_size;
+  CLAMP(rnn->info.output_size, 1, NN_MAX_NEURONS);
+  for (int i = 0; i < rnn->info.hidden_layers_size; i++) {
+    rnn->info.neurons_per[i] = params->neurons_per[i];
+    CLAMP(rnn->info.neurons_per[i], 1, NN_MAX_NEURONS);
+  }
+  rnn->info.learning_rate = fabs(params->learning_rate);
+  rnn->info.bptt_depth = params->bptt_depth;
+  CLAMP(rnn->info.bptt_depth, 1, RNN_MAX_DEPTH-1);  //allow for oldest - 1
+  rnn->info.bptt_stride = params->bptt_stride > 0 ? params->bptt_stride : rnn->info.bptt_depth;
+  CLAMP(rnn->info.bptt_stride, 1, rnn->info.bptt_depth);
+  rnn->info.clip_norm = fmax(0.0, params->clip_norm);
+  rnn->info.mode = params->mode;
+  rnn->info.output_feedback = RNN_seq_to_seq == rnn->info.mode && params->output_feedback;
+  rnn->info.teacher_forcing = params->teacher_forcing;
+  CLAMP(rnn->info.teacher_forcing, 0.0, 1.0);
+  rnn->input_width = rnn->info.input_size + (rnn->info.output_feedback ? rnn->info.output_size : 0);
+  CLAMP(rnn->input_width, 1, NN_MAX_NEURONS);
+  rnn->info.beta = params->beta;
+  CLAMP(rnn->info.beta, 0.0, 0.99);
+
+  for (int i = 0; i < RNN_MAX_DEPTH; i++) {
+    for (int j = 0; j < rnn->input_width; j++)
+      rnn->input.values[i][j] = 0.0;
+    for (int j = 0; j < rnn->info.output_size; j++)
+      rnn->target.values[i][j] = 0.0;
+    rnn->supervised[i] = 0;
+  }
+
+  init_recurrent_neural_first_hidden_layer(&rnn->hidden_layers[0], rnn->info.neurons_per[0], rnn->input_width, &rnn->input, rnn->info.bptt_depth);
+  int nls = rnn->info.hidden_layers_size;
+  for (int i = 1; i < nls; i++)
+    init_recurrent_neural_hidden_layer(&rnn->hidden_layers[i], &rnn->hidden_layers[i - 1], rnn->info.neurons_per[i], rnn->info.bptt_depth);
+  init_recurrent_neural_output_layer(&rnn->output_layer, &rnn->hidden_layers[nls - 1], rnn->info.output_size, rnn->info.bptt_depth);
+  rnn->t = 0;
+  rnn->beta_decay = rnn->info.beta;
+}
+
+double RNN_forward_propagate(RNN_neural_network_t *rnn, const double *input, const double *target) {
+  rnn->t++;
+  int now = rnn->t % RNN_MAX_DEPTH;
+  int then = (now - 1 + RNN_MAX_DEPTH) % RNN_MAX_DEPTH;
+
+  for (int i = 0; i < rnn->info.input_size; i++)
+    rnn->input.values[now][i] = input[i];
+
+  if (rnn->info.output_feedback) {
+    // teacher forcing feeds the ground truth back, otherwise the network sees its own prediction
+    double *feedback = &rnn->input.values[now][rnn->info.input_size];
+    int forced = rnn->supervised[then] && NN_random(1.0, 0.0) < rnn->info.teacher_forcing;
+    for (int i = 0; i < rnn->info.output_size; i++)
+      feedback[i] = forced ? rnn->target.values[then][i] : rnn->output_layer.neurons[i].history[then];
+  }
+
+  rnn->supervised[now] = target != NULL;
+  if (target) {
+    for (int i = 0; i < rnn->info.output_size; i++)
+      rnn->target.values[now][i] = target[i];
+  }
+
+  for (int i = 0; i < rnn->info.hidden_layers_size; i++) {
+    recurrent_neural_layer_propagate_hidden(&rnn->hidden_layers[i], rnn->input_width, now);
+  }
+  if (!target && RNN_seq_to_one == rnn->info.mode)
+    return 0.0;  // only the final step of the sequence is read out
+  recurrent_neural_layer_propagate_output(&rnn->output_layer, now);
+
+  if (!target) {
+    for (int i = 0; i < rnn->info.output_size; i++)
+      rnn->prediction[i] = rnn->output_layer.neurons[i].history[now];
+    return 0.0;
+  }
+
+  double mse = 0.0;
+  for (int i = 0; i < rnn->info.output_size; i++) {
+    rnn->prediction[i] = rnn->output_layer.neurons[i].history[now];
+    double diff = rnn->prediction[i] - rnn->target.values[now][i];
+    mse += (diff * diff);
+  }
+  return mse / (double) rnn->info.output_size;
+}
+
+static int feed_size(const RNN_neural_network_t *rnn, const RNN_neural_layer_t *layer) {
+  return layer->type == NN_first ? rnn->input_width : layer->feed->size;
+}
+
+// gathers the layer's feed at time 'when' into a contiguous row
+static void gather_feed(const RNN_neural_network_t *rnn, const RNN_neural_layer_t *layer, int when, double *values) {
+  if (layer->type == NN_first) {
+    for (int j = 0; j < rnn->input_width; j++)
+      values[j] = rnn->input.values[when][j];
+  } else {
+    for (int j = 0; j < layer->feed->size; j++)
+      values[j] = layer->feed->neurons[j].history[when];
+  }
+}
+
+static void gather_history(const RNN_neural_layer_t *layer, int when, double *values) {
+  for (int j = 0; j < layer->size; j++)
+    values[j] = layer->neurons[j].history[when];
+}
+
+static void zero_grads(RNN_neural_layer_t *layer, int n) {
+  for (int i = 0; i < layer->size; i++) {
+    RNN_neuron_t *neuron = &layer->neurons[i];
+    neuron->grad.bias = 0.0;
+    for (int j = 0; j < n; j++)
+      neuron->grad.weights[j] = 0.0;
+    for (int j = 0; j < layer->size; j++)
+      neuron->grad.recurrent_weights[j] = 0.0;
+  }
+}
+
+static void accumulate_grads(double *grads, const double *values, double delta, int n) {
+  for (int j = 0; j < n; j++)
+    grads[j] += delta * values[j];
+}
+
+// returns the sum of squares, folds min/max/sum into the metric fields
+static double reduce_grads(const double *grads, int n, int *count, double *lo, double *hi, double *sum) {
+  double sum_sq = 0.0, s = 0.0, mn = *lo, mx = *hi;
+  for (int j = 0; j < n; j++) {
+    double g = grads[j];
+    sum_sq += g * g;
+    s += g;
+    mn = MIN(mn, g);
+    mx = MAX(mx, g);
+  }
+  *count += n;
+  *lo = mn;
+  *hi = mx;
+  *sum += s;
+  return sum_sq;
+}
+
+static void apply_momentum_n(double *values, double *moments, const double *grads, int n, double beta, double learning_rate, double scale, double beta_correction_inv) {
+  double step = learning_rate * beta_correction_inv;
+  double mix = (1.0 - beta) * scale;
+  for (int j = 0; j < n; j++) {
+    moments[j] = beta * moments[j] + mix * grads[j];
+    values[j] -= step * moments[j];
+  }
+}
+
+void RNN_backward_propagate(RNN_neural_network_t *rnn, RNN_metrics_t *metrics) {
+  double learning_rate = rnn->info.learning_rate / (double) rnn->info.bptt_depth;
+  double beta = rnn->info.beta;
+  int depth = rnn->info.bptt_depth;
+  int nls = rnn->info.hidden_layers_size;
+  RNN_neural_layer_t *output_layer = &rnn->output_layer;
+  double feed[NN_MAX_NEURONS];
+  double previous[NN_MAX_NEURONS];
+
+  RNN_metrics_t m;
+  m.grad_count = m.recur_grad_count = m.delta_count = 0;
+  m.grad_min = m.recur_grad_min = m.delta_min = +INFINITY;
+  m.grad_max = m.recur_grad_max = m.delta_max = -INFINITY;
+  m.grad_mean = m.recur_grad_mean = m.delta_mean = 0.0;
+
+  // nothing flows back from past the newest step
+  int future = (rnn->t + 1) % RNN_MAX_DEPTH;
+  for (int l = 0; l < nls; l++) {
+    RNN_neural_layer_t *layer = &rnn->hidden_layers[l];
+    for (int i = 0; i < layer->size; i++)
+      layer->neurons[i].delta[future] = 0.0;
+    zero_grads(layer, feed_size(rnn, layer));
+  }
+  zero_grads(output_layer, output_layer->feed->size);
+
+  // deltas, newest to oldest so the recurrent term sees t + 1
+  for (int d = 0; d < depth; d++) {
+    int now = (rnn->t - d + RNN_MAX_DEPTH) % RNN_MAX_DEPTH;
+    int next = (now + 1) % RNN_MAX_DEPTH;
+    int supervised = rnn->supervised[now];
+    if (supervised) {
+      for (int i = 0; i < output_layer->size; i++) {
+        RNN_neuron_t *neuron = &output_layer->neurons[i];
+        double output = neuron->history[now];
+        neuron->delta[now] = (output - rnn->target.values[now][i]) * output_deriv(output);
+        m.delta_min = MIN(neuron->delta[now], m.delta_min);
+        m.delta_max = MAX(neuron->delta[now], m.delta_max);
+        m.delta_mean += neuron->delta[now];
+      }
+      m.delta_count += output_layer->size;
+    }
+
+    for (int l = nls - 1; l >= 0; l--) {
+      RNN_neural_layer_t *layer = &rnn->hidden_layers[l];
+      RNN_neural_layer_t *next_layer = l < nls - 1 ? &rnn->hidden_layers[l + 1] : output_layer;
+      // unsupervised steps get no error from the output layer, only through time
+      int next_size = (l < nls - 1 || supervised) ? next_layer->size : 0;
+      for (int i = 0; i < layer->size; i++) {
+        RNN_neuron_t *neuron = &layer->neurons[i];
+        double sum = 0.0;
+        for (int j = 0; j < next_size; j++)
+          sum += next_layer->neurons[j].delta[now] * next_layer->neurons[j].weights[i];
+        for (int j = 0; j < layer->size; j++)
+          sum += layer->neurons[j].delta[next] * layer->neurons[j].recurrent_weights[i];
+        neuron->delta[now] = sum * hidden_deriv(neuron->history[now]);
+        m.delta_min = MIN(neuron->delta[now], m.delta_min);
+        m.delta_max = MAX(neuron->delta[now], m.delta_max);
+        m.delta_mean += neuron->delta[now];
+      }
+      m.delta_count += layer->size;
+    }
+  }
+
+  // full gradients over the window
+  for (int d = 0; d < depth; d++) {
+    int now = (rnn->t - d + RNN_MAX_DEPTH) % RNN_MAX_DEPTH;
+    int then = (rnn->t - d - 1 + RNN_MAX_DEPTH) % RNN_MAX_DEPTH;
+
+    if (rnn->supervised[now]) {
+      gather_history(output_layer->feed, now, feed);
+      for (int i = 0; i < output_layer->size; i++) {
+        RNN_neuron_t *neuron = &output_layer->neurons[i];
+        neuron->grad.bias += neuron->delta[now];
+        accumulate_grads(neuron->grad.weights, feed, neuron->delta[now], output_layer->feed->size);
+      }
+    }
+
+    for (int l = 0; l < nls; l++) {
+      RNN_neural_layer_t *layer = &rnn->hidden_layers[l];
+      int n = feed_size(rnn, layer);
+      gather_feed(rnn, layer, now, feed);
+      gather_history(layer, then, previous);
+      for (int i = 0; i < layer->size; i++) {
+        RNN_neuron_t *neuron = &layer->neurons[i];
+        neuron->grad.bias += neuron->delta[now];
+        accumulate_grads(neuron->grad.weights, feed, neuron->delta[now], n);
+        accumulate_grads(neuron->grad.recurrent_weights, previous, neuron->delta[now], layer->size);
+      }
+    }
+  }
+
+  // one reduction for the global norm and the metrics
+  double sum_sq = 0.0;
+  for (int i = 0; i < output_layer->size; i++) {
+    RNN_neuron_t *neuron = &output_layer->neurons[i];
+    sum_sq += neuron->grad.bias * neuron->grad.bias;
+    sum_sq += reduce_grads(neuron->grad.weights, output_layer->feed->size, &m.grad_count, &m.grad_min, &m.grad_max, &m.grad_mean);
+  }
+  for (int l = 0; l < nls; l++) {
+    RNN_neural_layer_t *layer = &rnn->hidden_layers[l];
+    int n = feed_size(rnn, layer);
+    for (int i = 0; i < layer->size; i++) {
+      RNN_neuron_t *neuron = &layer->neurons[i];
+      sum_sq += neuron->grad.bias * neuron->grad.bias;
+      sum_sq += reduce_grads(neuron->grad.weights, n, &m.grad_count, &m.grad_min, &m.grad_max, &m.grad_mean);
+      sum_sq += reduce_grads(neuron->grad.recurrent_weights, layer->size, &m.recur_grad_count, &m.recur_grad_min, &m.recur_grad_max, &m.recur_grad_mean);
+    }
+  }
+  m.grad_norm = sqrt(sum_sq);
+  m.clip_scale = 1.0;
+  if (rnn->info.clip_norm > 0.0 && m.grad_norm > rnn->info.clip_norm)
+    m.clip_scale = rnn->info.clip_norm / m.grad_norm;
+
+  // fused weight and moment update
+  rnn->beta_decay *= rnn->info.beta;
+  double beta_correction_inv = 1.0 / fmax(1e-8, 1.0 - rnn->beta_decay);
+  double scale = m.clip_scale;
+
+  for (int i = 0; i < output_layer->size; i++) {
+    RNN_neuron_t *neuron = &output_layer->neurons[i];
+    apply_momentum(&neuron->bias, &neuron->moment.bias, beta, learning_rate, scale * neuron->grad.bias, beta_correction_inv);
+    apply_momentum_n(neuron->weights, neuron->moment.weights, neuron->grad.weights, output_layer->feed->size, beta, learning_rate, scale, beta_correction_inv);
+  }
+  for (int l = 0; l < nls; l++) {
+    RNN_neural_layer_t *layer = &rnn->hidden_layers[l];
+    int n = feed_size(rnn, layer);
+    for (int i = 0; i < layer->size; i++) {
+      RNN_neuron_t *neuron = &layer->neurons[i];
+      apply_momentum(&neuron->bias, &neuron->moment.bias, beta, learning_rate, scale * neuron->grad.bias, beta_correction_inv);
+      apply_momentum_n(neuron->weights, neuron->moment.weights, neuron->grad.weights, n, beta, learning_rate, scale, beta_correction_inv);
+      apply_momentum_n(neuron->recurrent_weights, neuron->moment.recurrent_weights, neuron->grad.recurrent_weights, layer->size, beta, learning_rate, scale, beta_correction_inv);
+    }
+  }
+
+  if (metrics) {
+    if (m.grad_count)
+      m.grad_mean /= (double) m.grad_count;
+    if (m.recur_grad_count)
+      m.recur_grad_mean /= (double) m.recur_grad_count;
+    if (m.delta_count)
+      m.delta_mean /= (double) m.delta_count;
+    *metrics = m;
+  }
+}
+
+double RNN_train_neural_network(RNN_neural_network_t *rnn, const double *input, const double *target) {
+  double mse = RNN_forward_propagate(rnn, input, target);
+  if (RNN_seq_to_one == rnn->info.mode) {
+    // the window ends on the sequence's only supervised step
+    if (target)
+      RNN_backward_propagate(rnn, NULL);
+    return mse;
+  }
+  // TBPTT(k1, k2): every k1 = bptt_stride steps, backpropagate k2 = bptt_depth steps. Each update runs its whole
+  // window from scratch, steps that overlapping windows share are backpropagated again with the newer weights
+  if (0 == (rnn->t % rnn->info.bptt_stride))
+    RNN_backward_propagate(rnn, NULL);  //not collecting metrics for now
+  return mse;
+}
+
+void RNN_reset_history(RNN_neural_network_t *rnn) {
+  for (int l = 0; l < rnn->info.hidden_layers_size; l++) {
+    RNN_neural_layer_t *layer = &rnn->hidden_layers[l];
+    for (int i = 0; i < layer->size; i++) {
+      RNN_neuron_t *neuron = &layer->neurons[i];
+      for (int j = 0; j < RNN_MAX_DEPTH; j++) {
+        neuron->delta[j] = neuron->history[j] = 0.0;
+      }
+    }
+  }
+  for (int i = 0; i < rnn->output_layer.size; i++)
+    for (int j = 0; j < RNN_MAX_DEPTH; j++)
+      rnn->output_layer.neurons[i].history[j] = 0.0;
+  for (int j = 0; j < RNN_MAX_DEPTH; j++)
+    rnn->supervised[j] = 0;
+}
+
+// text checkpoint: the info fields, then one line per neuron with its W: input weights, R: recurrent weights
+// (hidden layers only) and B: bias
+int RNN_export_neural_network(const RNN_neural_network_t *rnn, const char *filename) {
+  FILE *fp = fopen(filename, "w");
+  if (!fp)
+    return 0;
+  const RNN_info_t *info = &rnn->info;
+  fprintf(fp, "RNN %d %d %d %d %d %d %d\n", (int) info->mode, info->input_size, info->output_size, info->hidden_layers_size, info->bptt_depth, info->bptt_stride, info->output_feedback);
+  fprintf(fp, "NP");
+  for (int l = 0; l < info->hidden_layers_size; l++)
+    fprintf(fp, " %d", rnn->hidden_layers[l].size);
+  fprintf(fp, "\nLR %+.17g\nBE %+.17g\nCN %+.17g\nTF %+.17g\n", info->learning_rate, info->beta, info->clip_norm, info->teacher_forcing);
+  for (int l = 0; l < info->hidden_layers_size; l++) {
+    const RNN_neural_layer_t *layer = &rnn->hidden_layers[l];
+    fprintf(fp, "HID:\n");
+    for (int i = 0; i < layer->size; i++) {
+      const RNN_neuron_t *neuron = &layer->neurons[i];
+      for (int j = 0; j < feed_size(rnn, layer); j++)
+        fprintf(fp, "W:%+.17g ", neuron->weights[j]);
+      for (int j = 0; j < layer->size; j++)
+        fprintf(fp, "R:%+.17g ", neuron->recurrent_weights[j]);
+      fprintf(fp, "B:%+.17g\n", neuron->bias);
+    }
+  }
+  fprintf(fp, "OUT:\n");
+  for (int i = 0; i < rnn->output_layer.size; i++) {
+    const RNN_neuron_t *neuron = &rnn->output_layer.neurons[i];
+    for (int j = 0; j < rnn->output_layer.feed->size; j++)
+      fprintf(fp, "W:%+.17g ", neuron->weights[j]);
+    fprintf(fp, "B:%+.17g\n", neuron->bias);
+  }
+  int ok = !ferror(fp);
+  return 0 == fclose(fp) && ok;
+}
+
+static int read_recurrent_neuron(FILE *fp, RNN_neuron_t *neuron, int feed, int recurrent) {
+  for (int j = 0; j < feed; j++)
+    if (1 != fscanf(fp, " W:%lg", &neuron->weights[j]))
+      return 0;
+  for (int j = 0; j < recurrent; j++)
+    if (1 != fscanf(fp, " R:%lg", &neuron->recurrent_weights[j]))
+      return 0;
+  return 1 == fscanf(fp, " B:%lg", &neuron->bias);
+}
+
+static int read_tag(FILE *fp, const char *tag) {
+  char word[8];
+  return 1 == fscanf(fp, " %7s", word) && 0 == strcmp(word, tag);
+}
+
+static int read_recurrent_info(FILE *fp, RNN_info_t *info) {
+  int mode;
+  memset(info, 0, sizeof(RNN_info_t));
+  if (7 != fscanf(fp, "RNN %d %d %d %d %d %d %d", &mode, &info->input_size, &info->output_size, &info->hidden_layers_size, &info->bptt_depth, &info->bptt_stride, &info->output_feedback))
+    return 0;
+  info->mode = (RNN_mode_t) mode;
+  // sizes init would clamp mean a file this build can't hold
+  int width = info->input_size + (info->output_feedback ? info->output_size : 0);
+  if (info->input_size < 1 || info->output_size < 1 || info->output_size > NN_MAX_NEURONS || width > NN_MAX_NEURONS)
+    return 0;
+  if (info->hidden_layers_size < 1 || info->hidden_layers_size > NN_MAX_HIDDEN_LAYERS || !read_tag(fp, "NP"))
+    return 0;
+  for (int l = 0; l < info->hidden_layers_size; l++)
+    if (1 != fscanf(fp, "%d", &info->neurons_per[l]) || info->neurons_per[l] < 1 || info->neurons_per[l] > NN_MAX_NEURONS)
+      return 0;
+  return 4 == fscanf(fp, " LR %lg BE %lg CN %lg TF %lg", &info->learning_rate, &info->beta, &info->clip_norm, &info->teacher_forcing);
+}
+
+int RNN_import_neural_network(RNN_neural_network_t *rnn, const char *filename) {
+  FILE *fp = fopen(filename, "r");
+  if (!fp)
+    return 0;
+  RNN_info_t info;
+  int ok = read_recurrent_info(fp, &info);
+  if (ok)
+    RNN_init_neural_network(rnn, &info);
+  for (int l = 0; ok && l < rnn->info.hidden_layers_size; l++) {
+    RNN_neural_layer_t *layer = &rnn->hidden_layers[l];
+    ok = read_tag(fp, "HID:");
+    for (int i = 0; ok && i < layer->size; i++)
+      ok = read_recurrent_neuron(fp, &layer->neurons[i], feed_size(rnn, layer), layer->size);
+  }
+  ok = ok && read_tag(fp, "OUT:");
+  for (int i = 0; ok && i < rnn->output_layer.size; i++)
+    ok = read_recurrent_neuron(fp, &rnn->output_layer.neurons[i], rnn->output_layer.feed->size, 0);
+  fclose(fp);
+  return ok;
+}
+
+void RNN_reset_state(const RNN_neural_network_t *rnn, RNN_state_t *state) {
+  for (int l = 0; l < rnn->info.hidden_layers_size; l++)
+    for (int i = 0; i < rnn->hidden_layers[l].size; i++)
+      state->hidden[l][i] = 0.0;
+  for (int i = 0; i < rnn->output_layer.size; i++)
+    state->output[i] = 0.0;
+}
+
+// same math as RNN_forward_propagate, but the activations live in 'state' so the network is only read
+const double* RNN_step_state(const RNN_neural_network_t *rnn, RNN_state_t *state, const double *input) {
+  double next[NN_MAX_NEURONS];
+  double extended[NN_MAX_NEURONS];
+  const double *feed = input;
+  int feed_size = rnn->info.input_size;
+
+  if (rnn->info.output_feedback) {
+    // free running, the previous prediction is fed back
+    memcpy(extended, input, sizeof(double) * rnn->info.input_size);
+    memcpy(&extended[rnn->info.input_size], state->output, sizeof(double) * (rnn->input_width - rnn->info.input_size));
+    feed = extended;
+    feed_size = rnn->input_width;
+  }
+
+  for (int l = 0; l < rnn->info.hidden_layers_size; l++) {
+    const RNN_neural_layer_t *layer = &rnn->hidden_layers[l];
+    const double *previous = state->hidden[l];
+    for (int i = 0; i < layer->size; i++) {
+      const RNN_neuron_t *neuron = &layer->neurons[i];
+      double sum = neuron->bias;
+      for (int j = 0; j < feed_size; j++)
+        sum += neuron->weights[j] * feed[j];
+      for (int j = 0; j < layer->size; j++)
+        sum += neuron->recurrent_weights[j] * previous[j];
+      next[i] = hidden_act(sum);
+    }
+    memcpy(state->hidden[l], next, sizeof(double) * layer->size);
+    feed = state->hidden[l];
+    feed_size = layer->size;
+  }
+
+  const RNN_neural_layer_t *output_layer = &rnn->output_layer;
+  for (int i = 0; i < output_layer->size; i++) {
+    const RNN_neuron_t *neuron = &output_layer->neurons[i];
+    double sum = neuron->bias;
+    for (int j = 0; j < feed_size; j++)
+      sum += neuron->weights[j] * feed[j];
+    state->output[i] = output_act(sum);
+  }
+  return state->output;
+}
+
+typedef struct {
+  const RNN_neural_network_t *rnn;
+  const RNN_eval_sequence_t *sequences;
+  int count;
+  atomic_int next;  // work queue, threads pull sequence indices until it runs dry
+} eval_job_t;
+
+typedef struct {
+  eval_job_t *job;
+  double sum;
+  long steps;
+} eval_worker_t;
+
+static void* eval_worker(void *arg) {
+  eval_worker_t *worker = arg;
+  eval_job_t *job = worker->job;
+  const RNN_neural_network_t *rnn = job->rnn;
+  int output_size = rnn->info.output_size;
+  RNN_state_t state;  // about 9 KB, no allocation that could fail
+
+  for (int s = atomic_fetch_add(&job->next, 1); s < job->count; s = atomic_fetch_add(&job->next, 1)) {
+    const RNN_eval_sequence_t *sequence = &job->sequences[s];
+    RNN_reset_state(rnn, &state);
+    for (int t = 0; t < sequence->length; t++) {
+      const double *prediction = RNN_step_state(rnn, &state, &sequence->inputs[t * rnn->info.input_size]);
+      if (t < sequence->skip)
+        continue;
+      const double *target = &sequence->targets[t * output_size];
+      double mse = 0.0;
+      for (int i = 0; i < output_size; i++) {
+        double diff = prediction[i] - target[i];
+        mse += diff * diff;
+      }
+      worker->sum += mse / (double) output_size;
+      worker->steps++;
+    }
+  }
+  return NULL;
+}
+
+double RNN_evaluate_sequences(const RNN_neural_network_t *rnn, const RNN_eval_sequence_t *sequences, int count, int num_threads) {
+  CLAMP(num_threads, 1, 64);
+  num_threads = MIN(num_threads, MAX(count, 1));
+
+  eval_job_t job;
+  job.rnn = rnn;
+  job.sequences = sequences;
+  job.count = count;
+  atomic_init(&job.next, 0);
+
+  eval_worker_t workers[64];
+  pthread_t threads[64];
+  int spawned = 0;
+  for (int i = 0; i < num_threads; i++) {
+    workers[i].job = &job;
+    workers[i].sum = 0.0;
+    workers[i].steps = 0;
+  }
+  // worker 0 runs on the calling thread
+  for (int i = 1; i < num_threads; i++) {
+    if (0 != pthread_create(&threads[i], NULL, eval_worker, &workers[i]))
+      break;
+    spawned = i;
+  }
+  eval_worker(&workers[0]);
+  for (int i = 1; i <= spawned; i++)
+    pthread_join(threads[i], NULL);
+
+  double sum = 0.0;
+  long steps = 0;
+  for (int i = 0; i < num_threads; i++) {
+    sum += workers[i].sum;
+    steps += workers[i].steps;
+  }
+  return steps ? sum / (double) steps : 0.0;
+}
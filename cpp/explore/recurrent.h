@@ -0,0 +1,123 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "neural.h"
+
+#define RNN_MAX_DEPTH 40
+
+typedef enum {
+  RNN_seq_to_one,
+  RNN_seq_to_seq
+} RNN_mode_t;
+
+typedef struct {
+  RNN_mode_t mode;
+  double learning_rate;
+  double beta;
+  int input_size;
+  int output_size;
+  int hidden_layers_size;
+  int bptt_depth;   // k2, steps backpropagated per update
+  int bptt_stride;  // k1, steps between updates (0 means bptt_depth); below k2 windows overlap and shared steps are redone
+  double clip_norm;  // global gradient norm limit, 0 disables clipping
+  int output_feedback;     // seq_to_seq: previous output is appended to the input
+  double teacher_forcing;  // chance the appended output is the previous target instead of the prediction
+  int neurons_per[NN_MAX_HIDDEN_LAYERS];
+} RNN_info_t;
+
+typedef struct {
+  double weights[NN_MAX_NEURONS];
+  double recurrent_weights[NN_MAX_NEURONS];
+  double bias;
+  struct{
+    double weights[NN_MAX_NEURONS];
+    double recurrent_weights[NN_MAX_NEURONS];
+    double bias;
+  }moment;
+  struct{
+    double weights[NN_MAX_NEURONS];
+    double recurrent_weights[NN_MAX_NEURONS];
+    double bias;
+  }grad;  // accumulated over the bptt window
+
+  double history[RNN_MAX_DEPTH];
+  double delta[RNN_MAX_DEPTH];
+} RNN_neuron_t;
+
+typedef struct {
+  double values[RNN_MAX_DEPTH][NN_MAX_NEURONS];
+} RNN_sequence_t;
+
+typedef struct RNN_neural_layer_s {
+  int size;
+  NN_layer_type_t type;
+  RNN_neuron_t neurons[NN_MAX_NEURONS];
+  union {
+    struct RNN_neural_layer_s *feed;
+    const RNN_sequence_t *input;
+  };
+} RNN_neural_layer_t;
+
+typedef struct {
+  RNN_info_t info;
+  RNN_sequence_t input;
+  RNN_neural_layer_t hidden_layers[NN_MAX_HIDDEN_LAYERS];
+  RNN_neural_layer_t output_layer;
+  RNN_sequence_t target;
+  double prediction[NN_MAX_NEURONS];  //latest predictino
+  char supervised[RNN_MAX_DEPTH];  // step had a target
+  int input_width;  // input_size plus fed back outputs
+  int t;
+  double beta_decay;
+} RNN_neural_network_t;
+
+typedef struct {
+  int grad_count;
+  int recur_grad_count;
+  int delta_count;
+  double grad_min;
+  double grad_max;
+  double grad_mean;
+  double recur_grad_min;
+  double recur_grad_max;
+  double recur_grad_mean;
+  double delta_min;
+  double delta_max;
+  double delta_mean;
+  double grad_norm;   // global norm before clipping
+  double clip_scale;  // 1.0 when no clipping happened
+
+} RNN_metrics_t;
+
+// per-sequence activations, lets many sequences run against one read-only network
+typedef struct {
+  double hidden[NN_MAX_HIDDEN_LAYERS][NN_MAX_NEURONS];
+  double output[NN_MAX_NEURONS];
+} RNN_state_t;
+
+typedef struct {
+  const double *inputs;   // length x input_size, row-major
+  const double *targets;  // length x output_size, row-major
+  int length;
+  int skip;  // leading steps that only warm up the state and are not scored
+} RNN_eval_sequence_t;
+
+void RNN_init_neural_network(RNN_neural_network_t *rnn, const RNN_info_t *params);
+// a NULL target marks an unsupervised step, seq_to_one skips the output layer on those
+double RNN_forward_propagate(RNN_neural_network_t *rnn, const double *input, const double *target);
+void RNN_backward_propagate(RNN_neural_network_t *rnn, RNN_metrics_t *metrics);
+double RNN_train_neural_network(RNN_neural_network_t *rnn, const double *input, const double *target);
+void RNN_reset_history(RNN_neural_network_t *rnn);
+int RNN_export_neural_network(const RNN_neural_network_t *rnn, const char *filename);  // 0 when the file can't be written
+int RNN_import_neural_network(RNN_neural_network_t *rnn, const char *filename);  // rebuilds rnn from the file, 0 (rnn undefined) when it can't be read
+
+void RNN_reset_state(const RNN_neural_network_t *rnn, RNN_state_t *state);
+const double* RNN_step_state(const RNN_neural_network_t *rnn, RNN_state_t *state, const double *input);
+double RNN_evaluate_sequences(const RNN_neural_network_t *rnn, const RNN_eval_sequence_t *sequences, int count, int num_threads);  // mean MSE over scored steps
+
+#ifdef __cplusplus
+}
+#endif
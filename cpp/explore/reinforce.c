@@ -1,6 +1,10 @@
 #include <stdlib.h>
+#include <math.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "neural.h"
 #include "reinforce.h"
@@ -22,9 +26,104 @@
  static RL_action_t rl_action = { 0, RL_false };
  */
 
+// multi producer (acting), single consumer (learning) ring; slots carry a
+// seqlock so a reader never keeps a transition that was overwritten mid copy
+typedef struct RL_replay_s {
+  int capacity;
+  int width;  // network input size
+  int batch_size;
+  RL_bool prioritized;
+  double *states;  // capacity x width
+  double *next_states;  // capacity x width
+  int *actions;
+  double *rewards;
+  _Atomic double *priorities;  // |td error| of the slot's last update
+  atomic_uint *seqs;  // odd while a slot is being written
+  _Atomic double max_priority;
+  atomic_long head;  // transitions pushed so far
+  // learner side only: target network values of a slot, valid while seq and sync generation match
+  double *cache_qs;  // capacity x qcount
+  unsigned *cache_seqs;
+  unsigned *cache_generations;
+  // learner scratch for one mini-batch
+  double *batch_inputs;  // batch_size x width
+  double *batch_next_states;  // batch_size x width
+  double *batch_next_qs;  // batch_size x qcount
+  double *batch_select_qs;  // batch_size x qcount, online values for double Q-learning
+  double *batch_rewards;
+  int *batch_actions;
+  long *batch_slots;
+  unsigned *batch_seqs;
+  int *batch_misses;  // rows whose bootstrap values were not cached
+  double *miss_inputs;  // batch_size x width
+  double *miss_qs;  // batch_size x qcount
+} RL_replay_t;
+
+#define RL_REPLAY_CANDIDATES  4  // tournament size for prioritized sampling
+
+// per environment state and scratch rows for RL_step_vec, grown on demand
+typedef struct RL_vec_s {
+  int capacity;
+  RL_action_t *actions;  // last action of each environment, fed back as input
+  double *inputs;  // capacity x input_size
+  double *next_inputs;
+  double *qs;  // capacity x qcount
+  double *next_qs;
+  double *select_qs;
+  double *rewards;
+  int *taken;
+  // online values of the last step's next rows, the next step picks its actions from them when the rows still match
+  double *cache_inputs;  // capacity x input_size
+  double *cache_qs;  // capacity x qcount
+  int cached;  // leading rows of the cache that are valid
+  int *misses;  // rows whose values were not cached
+} RL_vec_t;
+
+typedef struct RL_actor_s {
+  struct RL_actors_s *pool;
+  pthread_t thread;
+  RL_agent_state_t *states;
+  int count;
+  NN_rng_t rand;  // NN_random belongs to the learner
+  atomic_ulong quiescent;  // bumped each time the actor lets go of its snapshot
+  RL_action_t *actions;
+  double *inputs;  // count x input_size
+  double *next_inputs;
+  double *qs;  // count x qcount
+} RL_actor_t;
+
+typedef struct RL_actors_s {
+  struct RL_ctx_s *ctx;
+  int count;
+  RL_actor_t *actors;
+  pthread_t learner;
+  atomic_int running;
+  _Atomic(NN_neural_network_t*) snapshot;  // read-only weights the actors act on
+  NN_neural_network_t *spare;  // learner owned, becomes the next snapshot
+  int publish_interval;  // learning updates between snapshots
+  atomic_long steps;
+  atomic_long consumed;  // transitions the learner has sampled
+} RL_actors_t;
+
+// tabular backend: Q rows in one flat array, open addressing with linear probing on the caller's state hash
+typedef struct RL_table_s {
+  int capacity;  // power of two, kept at most half full
+  int count;
+  int width;  // observation size, each row keeps its state's observation for RL_switch_to_neural
+  unsigned long long *keys;
+  unsigned char *used;
+  double *qs;  // capacity x qcount
+  double *inputs;  // capacity x width
+} RL_table_t;
+
+#define RL_TABLE_CAPACITY  64  // initial rows
+#define RL_TABLE_MAX_COUNT  (1 << 24)  // larger row counts in an imported file are taken as corrupt
+
 typedef struct RL_ctx_s {
   RL_type_t type;
   NN_neural_network_t *nn;
+  RNN_neural_network_t *rnn;
+  double input[NN_MAX_NEURONS];  // recurrent input (the rnn keeps its own copy per step), or the row RL_step is about to value
   double *qs[2];
   int qcount;
   RL_act_cb act;
@@ -36,25 +135,45 @@ typedef struct RL_ctx_s {
   RL_action_t action;
   RL_agent_state_t agent;
   RL_bool inited;
+  RL_bool action_inputs;  // the previous action leads each input row, cleared by RL_drop_action_inputs
+  RL_replay_t *replay;  // null when learning online
+  NN_neural_network_t *target;  // frozen copy for bootstrap values, null when disabled
+  int target_interval;  // learning updates between syncs
+  int target_updates;
+  unsigned target_generation;  // bumped on every sync
+  RL_bool double_q;
+  RL_vec_t vec;
+  RL_actors_t *actors;  // null unless actor-learner mode is running
+  RL_table_t *table;  // tabular backend, null for network agents
+  RL_hash_cb hash;
+  RL_bool peeked;  // the rnn's step after t already ran on the observation RL_step_recurrent will see next
+  RL_bool cached;  // the online network's input, activations and qs[NEXT_QS] are the last online step's next state
 } RL_ctx_t;
 
 #define CURR_QS  0
 #define NEXT_QS  1
 
-RL_agent_t RL_init(RL_type_t type, double alpha, double epsilon, double gamma, const NN_info_t *nn_info, RL_set_input_cb set, RL_reward_cb reward, RL_act_cb act, void *agent_info) {
+static RL_ctx_t* init_ctx(RL_type_t type, double alpha, double epsilon, double gamma, int qcount, RL_set_input_cb set, RL_reward_cb reward, RL_act_cb act, void *agent_info) {
   RL_ctx_t *ctx = malloc(sizeof(RL_ctx_t));
-  ctx->nn = malloc(sizeof(NN_neural_network_t));
-  NN_info_t info;
-  memcpy(&info, nn_info, sizeof(NN_info_t));
-  info.input_size += 2;  // action
-  NN_init_neural_network(ctx->nn, &info);
+  ctx->nn = RL_nullptr;
+  ctx->rnn = RL_nullptr;
+  ctx->replay = RL_nullptr;
+  ctx->target = RL_nullptr;
+  ctx->double_q = RL_false;
+  ctx->actors = RL_nullptr;
+  ctx->table = RL_nullptr;
+  ctx->hash = RL_nullptr;
+  ctx->peeked = RL_false;
+  ctx->cached = RL_false;
+  ctx->action_inputs = RL_true;
+  memset(&ctx->vec, 0, sizeof(RL_vec_t));
 
   ctx->type = type;
   ctx->alpha = alpha;
   ctx->epsilon = epsilon;
   ctx->gamma = gamma;
 
-  ctx->qcount = ctx->nn->output_size;
+  ctx->qcount = qcount;
   ctx->qs[0] = malloc(sizeof(double) * ctx->qcount);
   ctx->qs[1] = malloc(sizeof(double) * ctx->qcount);
 
@@ -64,18 +183,148 @@ RL_agent_t RL_init(RL_type_t type, double alpha, double epsilon, double gamma, c
   ctx->agent = agent_info;
 
   ctx->action = (RL_action_t ) { 0, RL_true };
-  ctx->nn->input[0] = (double) ctx->action.exploratory;
-  ctx->nn->input[1] = (double) ctx->action.taken;
-  ctx->set(ctx->agent, &ctx->nn->input[2]);
+  return ctx;
+}
+
+// writes one network input row: the action that led to the state (unless dropped), then the state's observation
+static void set_input(RL_ctx_t *ctx, RL_action_t action, RL_agent_state_t state, double *input) {
+  if (!ctx->set)
+    return;  // an engine with its own environment loop writes the rows
+  if (!ctx->action_inputs) {
+    ctx->set(state, input);
+    return;
+  }
+  input[0] = (double) action.exploratory;
+  input[1] = (double) action.taken;
+  ctx->set(state, &input[2]);
+}
+
+RL_agent_t RL_init(RL_type_t type, double alpha, double epsilon, double gamma, const NN_info_t *nn_info, RL_set_input_cb set, RL_reward_cb reward, RL_act_cb act, void *agent_info) {
+  NN_neural_network_t *nn = malloc(sizeof(NN_neural_network_t));
+  NN_info_t info;
+  memcpy(&info, nn_info, sizeof(NN_info_t));
+  info.input_size += 2;  // action
+  NN_init_neural_network(nn, &info);
+
+  RL_ctx_t *ctx = init_ctx(type, alpha, epsilon, gamma, nn->output_size, set, reward, act, agent_info);
+  ctx->nn = nn;
+  set_input(ctx, ctx->action, ctx->agent, ctx->nn->input);
+  ctx->inited = RL_true;
+  return ctx;
+}
+
+RL_bool RL_drop_action_inputs(RL_agent_t agent) {
+  RL_ctx_t *ctx = agent;
+  if (!ctx->nn || ctx->replay || ctx->target || ctx->actors || ctx->vec.capacity)
+    return RL_false;  // every buffer sized by the input width must come after
+  if (!ctx->action_inputs)
+    return RL_true;
+  NN_info_t info = ctx->nn->info;
+  info.input_size -= 2;
+  NN_init_neural_network(ctx->nn, &info);
+  ctx->action_inputs = RL_false;
+  ctx->cached = RL_false;
+  set_input(ctx, ctx->action, ctx->agent, ctx->nn->input);
+  return RL_true;
+}
+
+RL_agent_t RL_init_recurrent(RL_type_t type, double alpha, double epsilon, double gamma, const RNN_info_t *rnn_info, RL_set_input_cb set, RL_reward_cb reward, RL_act_cb act, void *agent_info) {
+  RNN_neural_network_t *rnn = malloc(sizeof(RNN_neural_network_t));
+  RNN_info_t info;
+  memcpy(&info, rnn_info, sizeof(RNN_info_t));
+  info.input_size += 2;  // action
+  RNN_init_neural_network(rnn, &info);
+
+  RL_ctx_t *ctx = init_ctx(type, alpha, epsilon, gamma, rnn->info.output_size, set, reward, act, agent_info);
+  ctx->rnn = rnn;
+  for (int i = 0; i < ctx->qcount; i++)
+    ctx->qs[CURR_QS][i] = ctx->qs[NEXT_QS][i] = 0.0;
   ctx->inited = RL_true;
   return ctx;
 }
 
-static int q_max(RL_ctx_t *ctx, int type) {
-  double *qs = type == CURR_QS ? ctx->qs[CURR_QS] : ctx->qs[NEXT_QS];
+static void table_alloc(RL_table_t *table, int capacity, int width, int qcount) {
+  table->capacity = capacity;
+  table->count = 0;
+  table->width = width;
+  table->keys = malloc(sizeof(unsigned long long) * capacity);
+  table->used = calloc(capacity, 1);
+  table->qs = malloc(sizeof(double) * capacity * qcount);
+  table->inputs = malloc(sizeof(double) * capacity * width);
+}
+
+static void table_free(RL_table_t *table) {
+  free(table->keys);
+  free(table->used);
+  free(table->qs);
+  free(table->inputs);
+}
+
+// small state ids hash to neighbouring slots, spread them before probing
+static unsigned long long table_mix(unsigned long long key) {
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ULL;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebULL;
+  return key ^ (key >> 31);
+}
+
+// the key's slot, or the empty slot it would go in
+static int table_find(const RL_table_t *table, unsigned long long key) {
+  int mask = table->capacity - 1;
+  int slot = (int) (table_mix(key) & mask);
+  while (table->used[slot] && table->keys[slot] != key)
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+static void table_grow(RL_ctx_t *ctx) {
+  RL_table_t *old = ctx->table;
+  RL_table_t grown;
+  table_alloc(&grown, old->capacity * 2, old->width, ctx->qcount);
+  for (int i = 0; i < old->capacity; i++) {
+    if (!old->used[i])
+      continue;
+    int slot = table_find(&grown, old->keys[i]);
+    grown.used[slot] = 1;
+    grown.keys[slot] = old->keys[i];
+    memcpy(&grown.qs[slot * ctx->qcount], &old->qs[i * ctx->qcount], sizeof(double) * ctx->qcount);
+    memcpy(&grown.inputs[slot * old->width], &old->inputs[i * old->width], sizeof(double) * old->width);
+  }
+  grown.count = old->count;
+  table_free(old);
+  *old = grown;
+}
+
+// the state's row, a new state starts with all action values at zero
+static int table_row(RL_ctx_t *ctx, unsigned long long key, RL_agent_state_t state) {
+  RL_table_t *table = ctx->table;
+  int slot = table_find(table, key);
+  if (table->used[slot])
+    return slot;
+  table->used[slot] = 1;
+  table->keys[slot] = key;
+  memset(&table->qs[slot * ctx->qcount], 0, sizeof(double) * ctx->qcount);
+  if (state)
+    ctx->set(state, &table->inputs[slot * table->width]);
+  table->count++;
+  return slot;
+}
+
+RL_agent_t RL_init_tabular(RL_type_t type, double alpha, double epsilon, double gamma, int input_size, int action_count, RL_hash_cb hash, RL_set_input_cb set, RL_reward_cb reward, RL_act_cb act, void *agent_info) {
+  RL_ctx_t *ctx = init_ctx(type, alpha, epsilon, gamma, action_count, set, reward, act, agent_info);
+  ctx->hash = hash;
+  ctx->table = malloc(sizeof(RL_table_t));
+  table_alloc(ctx->table, RL_TABLE_CAPACITY, input_size, action_count);
+  ctx->action_inputs = RL_false;  // rows are keyed on the state alone
+  ctx->inited = RL_true;
+  return ctx;
+}
+
+static int q_argmax(const double *qs, int qcount) {
   int best = 0;
   double q = qs[0];
-  for (int i = 1; i < ctx->qcount; i++) {
+  for (int i = 1; i < qcount; i++) {
     if (qs[i] > q) {
       best = i;
       q = qs[i];
@@ -84,62 +333,790 @@ static int q_max(RL_ctx_t *ctx, int type) {
   return best;
 }
 
-static RL_action_t e_greedy(RL_ctx_t *ctx) {
+// rand is an actor's own stream, null for NN_random
+static RL_action_t e_greedy_qs(RL_ctx_t *ctx, const double *qs, NN_rng_t *rand) {
   RL_action_t action = { 0, RL_false };
-  if (NN_random(1.0, 0.0) < ctx->epsilon) {
+  if ((rand ? NN_rng_random(rand, 1.0, 0.0) : NN_random(1.0, 0.0)) < ctx->epsilon) {
     action.exploratory = RL_true;
-    action.taken = (int) NN_random((double) ctx->qcount, 0.0);
+    action.taken = (int) ((rand ? NN_rng_random(rand, 1.0, 0.0) : NN_random(1.0, 0.0)) * ctx->qcount);
   } else {
-    action.taken = q_max(ctx, CURR_QS);
+    action.taken = q_argmax(qs, ctx->qcount);
     action.exploratory = RL_false;
   }
   return action;
+}
 
+static RL_action_t e_greedy(RL_ctx_t *ctx) {
+  return e_greedy_qs(ctx, ctx->qs[CURR_QS], RL_nullptr);
 }
 
 static void update_qvalues(RL_ctx_t *ctx, int which) {
-  // which = which == NEXT_QS ? NEXT_QS : CURR_QS;
-  ctx->nn->input[0] = (double) ctx->action.exploratory;
-  ctx->nn->input[1] = (double) ctx->action.taken;
-  ctx->set(ctx->agent, &ctx->nn->input[2]);
+  set_input(ctx, ctx->action, ctx->agent, ctx->nn->input);
   NN_forward_propagate(ctx->nn);
   for (int i = 0; i < ctx->qcount; i++)
     ctx->qs[which][i] = ctx->nn->output_layer.neurons[i].value;
 }
 
+// select_qs picks the greedy action for double Q-learning, null to pick it from next_qs
+static double td_target(RL_ctx_t *ctx, double reward, int action, const double *next_qs, const double *select_qs) {
+  if (RL_sarsa == ctx->type)
+    return reward + ctx->gamma * next_qs[action];
+  int best = q_argmax(select_qs ? select_qs : next_qs, ctx->qcount);
+  return reward + ctx->gamma * next_qs[best];
+}
+
+// a new row's values are all zero, ties break at random or every fresh state would send the agent the same way
+static int table_argmax(const double *qs, int qcount) {
+  int best = 0;
+  int ties = 1;
+  for (int i = 1; i < qcount; i++) {
+    if (qs[i] > qs[best]) {
+      best = i;
+      ties = 1;
+    } else if (qs[i] == qs[best] && NN_random((double) ++ties, 0.0) < 1.0)
+      best = i;
+  }
+  return best;
+}
+
+static void table_step(RL_ctx_t *ctx, RL_bool learn) {
+  RL_table_t *table = ctx->table;
+  if (2 * (table->count + 2) > table->capacity)
+    table_grow(ctx);  // both rows this step may add then land without a rehash moving the first
+  int row = table_row(ctx, ctx->hash(ctx->agent), ctx->agent);
+  double *qs = &table->qs[row * ctx->qcount];
+  if (learn) {
+    ctx->action = e_greedy_qs(ctx, qs, RL_nullptr);
+    if (!ctx->action.exploratory)
+      ctx->action.taken = table_argmax(qs, ctx->qcount);
+  } else
+    ctx->action = (RL_action_t ) { table_argmax(qs, ctx->qcount), RL_false };
+  ctx->act(ctx->agent, ctx->action.taken);
+  if (!learn)
+    return;
+  double reward = ctx->reward(ctx->agent);
+  int next = table_row(ctx, ctx->hash(ctx->agent), ctx->agent);
+
+  double target = td_target(ctx, reward, ctx->action.taken, &table->qs[next * ctx->qcount], RL_nullptr);
+  qs[ctx->action.taken] += ctx->alpha * (target - qs[ctx->action.taken]);
+}
+
+RL_bool RL_switch_to_neural(RL_agent_t agent, const NN_info_t *nn_info, int epochs) {
+  RL_ctx_t *ctx = agent;
+  RL_table_t *table = ctx->table;
+  if (!table || nn_info->input_size != table->width || nn_info->output_size != ctx->qcount)
+    return RL_false;
+  NN_neural_network_t *nn = malloc(sizeof(NN_neural_network_t));
+  NN_init_neural_network(nn, nn_info);
+
+  // regress the network onto the table, every visited state once per epoch in a fresh order
+  int *order = malloc(sizeof(int) * (table->count ? table->count : 1));
+  int count = 0;
+  for (int i = 0; i < table->capacity; i++)
+    if (table->used[i])
+      order[count++] = i;
+  for (int e = 0; e < epochs; e++) {
+    for (int i = count - 1; i > 0; i--) {
+      int j = (int) NN_random((double) (i + 1), 0.0);
+      int swap = order[i];
+      order[i] = order[j];
+      order[j] = swap;
+    }
+    for (int i = 0; i < count; i++) {
+      memcpy(nn->input, &table->inputs[order[i] * table->width], sizeof(double) * table->width);
+      memcpy(nn->target, &table->qs[order[i] * ctx->qcount], sizeof(double) * ctx->qcount);
+      NN_train_neural_network(nn);
+    }
+  }
+  free(order);
+
+  table_free(table);
+  free(table);
+  ctx->table = RL_nullptr;
+  ctx->nn = nn;
+  ctx->cached = RL_false;
+  set_input(ctx, ctx->action, ctx->agent, ctx->nn->input);
+  return RL_true;
+}
+
+void RL_enable_target_network(RL_agent_t agent, int sync_interval, RL_bool double_q) {
+  RL_ctx_t *ctx = agent;
+  if (!ctx->nn || ctx->target)
+    return;
+  ctx->target = malloc(sizeof(NN_neural_network_t));
+  NN_init_neural_network(ctx->target, &ctx->nn->info);
+  NN_copy_weights(ctx->target, ctx->nn);
+  ctx->target_interval = sync_interval < 1 ? 1 : sync_interval;
+  ctx->target_updates = 0;
+  ctx->target_generation = 1;
+  ctx->double_q = double_q;
+}
+
+static void target_tick(RL_ctx_t *ctx) {
+  if (!ctx->target || ++ctx->target_updates < ctx->target_interval)
+    return;
+  NN_copy_weights(ctx->target, ctx->nn);
+  ctx->target_updates = 0;
+  ctx->target_generation++;
+}
+
+// one mini-batch update from predictions of the current weights: only each row's taken action moves, alpha of
+// the way to its td target, the other outputs are their own targets. targets holds the td targets on entry and
+// the td errors on return
+static void fit_batch(RL_ctx_t *ctx, const double *inputs, const int *actions, double *targets, int count) {
+  NN_neural_network_t *nn = ctx->nn;
+  int width = nn->input_size;
+  ctx->cached = RL_false;
+  if (count > 1)
+    NN_zero_gradients(nn);
+  for (int k = 0; k < count; k++) {
+    int action = actions[k];
+    memcpy(nn->input, &inputs[k * width], sizeof(double) * width);
+    NN_forward_propagate(nn);
+    targets[k] -= nn->prediction[action];
+    memcpy(nn->target, nn->prediction, sizeof(double) * ctx->qcount);
+    nn->target[action] += ctx->alpha * targets[k];
+    if (1 == count)
+      NN_backward_propagate(nn);  // the same step for a lone row, without the accumulators
+    else
+      NN_accumulate_gradients(nn);
+  }
+  if (count > 1)
+    NN_apply_gradients(nn, count);
+  target_tick(ctx);
+}
+
+// bootstrap values for count next states, returns the rows td_target selects actions from
+static const double* bootstrap_qs(RL_ctx_t *ctx, const double *next_inputs, double *next_qs, double *select_qs, int count) {
+  NN_forward_batch(ctx->target ? ctx->target : ctx->nn, next_inputs, next_qs, count);
+  if (!ctx->target || !ctx->double_q || RL_sarsa == ctx->type)
+    return RL_nullptr;
+  NN_forward_batch(ctx->nn, next_inputs, select_qs, count);
+  return select_qs;
+}
+
+static void replay_push(RL_replay_t *rb, const double *state, int action, double reward, const double *next_state) {
+  long head = atomic_fetch_add_explicit(&rb->head, 1, memory_order_relaxed);
+  int slot = (int) (head % rb->capacity);
+  // new transitions get the largest priority seen so far so each is replayed at least once
+  double priority = atomic_load_explicit(&rb->max_priority, memory_order_relaxed);
+
+  // claim the slot, a producer that lapped the ring may still be writing it
+  unsigned seq = atomic_load_explicit(&rb->seqs[slot], memory_order_relaxed);
+  while ((seq & 1) || !atomic_compare_exchange_weak_explicit(&rb->seqs[slot], &seq, seq + 1, memory_order_relaxed, memory_order_relaxed))
+    seq = atomic_load_explicit(&rb->seqs[slot], memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  memcpy(&rb->states[slot * rb->width], state, sizeof(double) * rb->width);
+  memcpy(&rb->next_states[slot * rb->width], next_state, sizeof(double) * rb->width);
+  rb->actions[slot] = action;
+  rb->rewards[slot] = reward;
+  atomic_store_explicit(&rb->priorities[slot], priority, memory_order_relaxed);
+  atomic_store_explicit(&rb->seqs[slot], seq + 2, memory_order_release);
+}
+
+// returns the slot's sequence, 0 when no transition has landed in it yet
+static unsigned replay_read(RL_replay_t *rb, long slot, double *state, int *action, double *reward, double *next_state) {
+  for (;;) {
+    unsigned seq = atomic_load_explicit(&rb->seqs[slot], memory_order_acquire);
+    if (0 == seq)
+      return 0;
+    if (seq & 1)
+      continue;
+    memcpy(state, &rb->states[slot * rb->width], sizeof(double) * rb->width);
+    memcpy(next_state, &rb->next_states[slot * rb->width], sizeof(double) * rb->width);
+    *action = rb->actions[slot];
+    *reward = rb->rewards[slot];
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&rb->seqs[slot], memory_order_relaxed) == seq)
+      return seq;
+  }
+}
+
+static long replay_sample(RL_replay_t *rb, long filled) {
+  long slot = (long) NN_random((double) filled, 0.0);
+  if (!rb->prioritized)
+    return slot;
+  // tournament selection approximates proportional prioritization without a shared sum tree
+  double priority = atomic_load_explicit(&rb->priorities[slot], memory_order_relaxed);
+  for (int i = 1; i < RL_REPLAY_CANDIDATES; i++) {
+    long candidate = (long) NN_random((double) filled, 0.0);
+    double p = atomic_load_explicit(&rb->priorities[candidate], memory_order_relaxed);
+    if (p > priority) {
+      slot = candidate;
+      priority = p;
+    }
+  }
+  return slot;
+}
+
+void RL_enable_replay(RL_agent_t agent, int capacity, int batch_size, RL_bool prioritized) {
+  RL_ctx_t *ctx = agent;
+  if (!ctx->nn || ctx->replay || capacity <= 0 || batch_size <= 0)
+    return;
+  RL_replay_t *rb = malloc(sizeof(RL_replay_t));
+  rb->capacity = capacity;
+  rb->width = ctx->nn->input_size;
+  rb->batch_size = batch_size;
+  rb->prioritized = prioritized;
+  rb->states = malloc(sizeof(double) * capacity * rb->width);
+  rb->next_states = malloc(sizeof(double) * capacity * rb->width);
+  rb->actions = malloc(sizeof(int) * capacity);
+  rb->rewards = malloc(sizeof(double) * capacity);
+  rb->priorities = malloc(sizeof(_Atomic double) * capacity);
+  rb->seqs = malloc(sizeof(atomic_uint) * capacity);
+  for (int i = 0; i < capacity; i++) {
+    atomic_init(&rb->priorities[i], 1.0);
+    atomic_init(&rb->seqs[i], 0);
+  }
+  atomic_init(&rb->head, 0);
+  atomic_init(&rb->max_priority, 1.0);
+  rb->cache_qs = malloc(sizeof(double) * capacity * ctx->qcount);
+  rb->cache_seqs = calloc(capacity, sizeof(unsigned));
+  rb->cache_generations = calloc(capacity, sizeof(unsigned));  // generation 0 is never current
+  rb->batch_inputs = malloc(sizeof(double) * batch_size * rb->width);
+  rb->batch_next_states = malloc(sizeof(double) * batch_size * rb->width);
+  rb->batch_next_qs = malloc(sizeof(double) * batch_size * ctx->qcount);
+  rb->batch_select_qs = malloc(sizeof(double) * batch_size * ctx->qcount);
+  rb->batch_rewards = malloc(sizeof(double) * batch_size);
+  rb->batch_actions = malloc(sizeof(int) * batch_size);
+  rb->batch_slots = malloc(sizeof(long) * batch_size);
+  rb->batch_seqs = malloc(sizeof(unsigned) * batch_size);
+  rb->batch_misses = malloc(sizeof(int) * batch_size);
+  rb->miss_inputs = malloc(sizeof(double) * batch_size * rb->width);
+  rb->miss_qs = malloc(sizeof(double) * batch_size * ctx->qcount);
+  ctx->replay = rb;
+}
+
+static void replay_term(RL_replay_t *rb) {
+  free(rb->states);
+  free(rb->next_states);
+  free(rb->actions);
+  free(rb->rewards);
+  free(rb->priorities);
+  free(rb->seqs);
+  free(rb->cache_qs);
+  free(rb->cache_seqs);
+  free(rb->cache_generations);
+  free(rb->batch_inputs);
+  free(rb->batch_next_states);
+  free(rb->batch_next_qs);
+  free(rb->batch_select_qs);
+  free(rb->batch_rewards);
+  free(rb->batch_actions);
+  free(rb->batch_slots);
+  free(rb->batch_seqs);
+  free(rb->batch_misses);
+  free(rb->miss_inputs);
+  free(rb->miss_qs);
+  free(rb);
+}
+
+int RL_learn(RL_agent_t agent) {
+  RL_ctx_t *ctx = agent;
+  RL_replay_t *rb = ctx->replay;
+  if (!rb)
+    return 0;
+  long head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+  long filled = head < rb->capacity ? head : rb->capacity;
+  if (filled < rb->batch_size)
+    return 0;
+
+  NN_neural_network_t *nn = ctx->nn;
+  int width = rb->width;
+  int qcount = ctx->qcount;
+  int count = rb->batch_size;
+  for (int k = 0; k < count; k++) {
+    // with several producers a claimed slot can still be empty, draw again
+    do {
+      long slot = replay_sample(rb, filled);
+      rb->batch_slots[k] = slot;
+      rb->batch_seqs[k] = replay_read(rb, slot, &rb->batch_inputs[k * width], &rb->batch_actions[k], &rb->batch_rewards[k], &rb->batch_next_states[k * width]);
+    } while (0 == rb->batch_seqs[k]);
+  }
+
+  // bootstrap values in one batched pass; a frozen target network's values are reused until the next sync
+  int misses = 0;
+  for (int k = 0; k < count; k++) {
+    long slot = rb->batch_slots[k];
+    if (ctx->target && rb->cache_generations[slot] == ctx->target_generation && rb->cache_seqs[slot] == rb->batch_seqs[k]) {
+      memcpy(&rb->batch_next_qs[k * qcount], &rb->cache_qs[slot * qcount], sizeof(double) * qcount);
+      continue;
+    }
+    memcpy(&rb->miss_inputs[misses * width], &rb->batch_next_states[k * width], sizeof(double) * width);
+    rb->batch_misses[misses++] = k;
+  }
+  NN_forward_batch(ctx->target ? ctx->target : nn, rb->miss_inputs, rb->miss_qs, misses);
+  for (int m = 0; m < misses; m++) {
+    int k = rb->batch_misses[m];
+    memcpy(&rb->batch_next_qs[k * qcount], &rb->miss_qs[m * qcount], sizeof(double) * qcount);
+    if (ctx->target) {
+      long slot = rb->batch_slots[k];
+      memcpy(&rb->cache_qs[slot * qcount], &rb->miss_qs[m * qcount], sizeof(double) * qcount);
+      rb->cache_seqs[slot] = rb->batch_seqs[k];
+      rb->cache_generations[slot] = ctx->target_generation;
+    }
+  }
+  const double *select_qs = RL_nullptr;
+  if (ctx->target && ctx->double_q && RL_qlearn == ctx->type) {
+    NN_forward_batch(nn, rb->batch_next_states, rb->batch_select_qs, count);
+    select_qs = rb->batch_select_qs;
+  }
+
+  // the rewards become td targets, then td errors
+  double *tds = rb->batch_rewards;
+  for (int k = 0; k < count; k++)
+    tds[k] = td_target(ctx, tds[k], rb->batch_actions[k], &rb->batch_next_qs[k * qcount], select_qs ? &select_qs[k * qcount] : RL_nullptr);
+  fit_batch(ctx, rb->batch_inputs, rb->batch_actions, tds, count);
+  for (int k = 0; rb->prioritized && k < count; k++) {
+    long slot = rb->batch_slots[k];
+    double priority = fabs(tds[k]) + 1e-3;
+    atomic_store_explicit(&rb->priorities[slot], priority, memory_order_relaxed);
+    if (priority > atomic_load_explicit(&rb->max_priority, memory_order_relaxed))
+      atomic_store_explicit(&rb->max_priority, priority, memory_order_relaxed);
+  }
+  return count;
+}
+
 void RL_step(RL_agent_t agent) {
   RL_ctx_t *ctx = agent;
-  if (!ctx->inited)
+  if (ctx->inited && ctx->table) {
+    table_step(ctx, RL_true);
+    return;
+  }
+  if (!ctx->inited || !ctx->nn || ctx->actors)
     return;
 
-  update_qvalues(ctx, CURR_QS);
+  // the last online step already ran the network on this state, unless the environment moved in between
+  NN_neural_network_t *nn = ctx->nn;
+  set_input(ctx, ctx->action, ctx->agent, ctx->input);
+  if (ctx->cached && 0 == memcmp(ctx->input, nn->input, sizeof(double) * nn->input_size))
+    memcpy(ctx->qs[CURR_QS], ctx->qs[NEXT_QS], sizeof(double) * ctx->qcount);
+  else
+    update_qvalues(ctx, CURR_QS);
+  ctx->cached = RL_false;
 
-  // RL_action_t last_action = ctx->action;
   ctx->action = e_greedy(ctx);
   ctx->act(ctx->agent, ctx->action.taken);
   double reward = ctx->reward(ctx->agent);
 
+  if (ctx->replay) {
+    // acting only records the transition, learning happens on replayed mini-batches
+    double state[NN_MAX_NEURONS];
+    memcpy(state, ctx->nn->input, sizeof(double) * ctx->nn->input_size);
+    set_input(ctx, ctx->action, ctx->agent, ctx->nn->input);
+    replay_push(ctx->replay, state, ctx->action.taken, reward, ctx->nn->input);
+    RL_learn(ctx);
+    return;
+  }
+
+  if (ctx->target) {
+    // the next state goes to a scratch row, the online activations stay those of the current state
+    double select_qs[NN_MAX_NEURONS];
+    set_input(ctx, ctx->action, ctx->agent, ctx->input);
+    const double *select = bootstrap_qs(ctx, ctx->input, ctx->qs[NEXT_QS], select_qs, 1);
+    double target = td_target(ctx, reward, ctx->action.taken, ctx->qs[NEXT_QS], select);
+    for (int i = 0; i < ctx->qcount; i++)
+      ctx->nn->target[i] = ctx->qs[CURR_QS][i];
+    ctx->nn->target[ctx->action.taken] += ctx->alpha * (target - ctx->qs[CURR_QS][ctx->action.taken]);
+    NN_backward_propagate(ctx->nn);
+    target_tick(ctx);
+    return;
+  }
+
+  // the gradient of the taken action's value is taken on the current state's activations before the next state's
+  // pass replaces them; that pass stays for the next step, whose values are then one update stale
+  memcpy(nn->target, nn->prediction, sizeof(double) * ctx->qcount);
+  nn->target[ctx->action.taken] -= 1.0;
+  NN_zero_gradients(nn);
+  NN_accumulate_gradients(nn);
+
   update_qvalues(ctx, NEXT_QS);
+  ctx->cached = RL_true;
 
-  double target = 0.0;
-  if (RL_sarsa == ctx->type)
-    target = reward + ctx->gamma * ctx->qs[NEXT_QS][ctx->action.taken];
-  if (RL_qlearn == ctx->type) {
-    int best = q_max(ctx, NEXT_QS);
-    target = reward + ctx->gamma * ctx->qs[NEXT_QS][best];
+  double target = td_target(ctx, reward, ctx->action.taken, ctx->qs[NEXT_QS], RL_nullptr);
+  NN_apply_scaled_gradients(nn, -ctx->alpha * (target - ctx->qs[CURR_QS][ctx->action.taken]));
+}
+
+static void vec_reserve(RL_ctx_t *ctx, int count) {
+  RL_vec_t *vec = &ctx->vec;
+  if (count <= vec->capacity)
+    return;
+  int width = ctx->nn->input_size;
+  vec->actions = realloc(vec->actions, sizeof(RL_action_t) * count);
+  for (int k = vec->capacity; k < count; k++)
+    vec->actions[k] = (RL_action_t ) { 0, RL_true };
+  vec->inputs = realloc(vec->inputs, sizeof(double) * count * width);
+  vec->next_inputs = realloc(vec->next_inputs, sizeof(double) * count * width);
+  vec->qs = realloc(vec->qs, sizeof(double) * count * ctx->qcount);
+  vec->next_qs = realloc(vec->next_qs, sizeof(double) * count * ctx->qcount);
+  vec->select_qs = realloc(vec->select_qs, sizeof(double) * count * ctx->qcount);
+  vec->rewards = realloc(vec->rewards, sizeof(double) * count);
+  vec->taken = realloc(vec->taken, sizeof(int) * count);
+  vec->cache_inputs = realloc(vec->cache_inputs, sizeof(double) * count * width);
+  vec->cache_qs = realloc(vec->cache_qs, sizeof(double) * count * ctx->qcount);
+  vec->misses = realloc(vec->misses, sizeof(int) * count);
+  vec->capacity = count;
+}
+
+static void vec_gather(RL_ctx_t *ctx, RL_agent_state_t *states, int count, double *inputs) {
+  int width = ctx->nn->input_size;
+  for (int k = 0; k < count; k++)
+    set_input(ctx, ctx->vec.actions[k], states[k], &inputs[k * width]);
+}
+
+// action values for the gathered rows: the cached ones are copied, one batched pass covers the rest
+static void vec_qvalues(RL_ctx_t *ctx, int count) {
+  RL_vec_t *vec = &ctx->vec;
+  int width = ctx->nn->input_size;
+  int qcount = ctx->qcount;
+  int misses = 0;
+  for (int k = 0; k < count; k++) {
+    if (k < vec->cached && 0 == memcmp(&vec->inputs[k * width], &vec->cache_inputs[k * width], sizeof(double) * width)) {
+      memcpy(&vec->qs[k * qcount], &vec->cache_qs[k * qcount], sizeof(double) * qcount);
+      continue;
+    }
+    // next rows are free until the environments act, they hold the misses
+    memcpy(&vec->next_inputs[misses * width], &vec->inputs[k * width], sizeof(double) * width);
+    vec->misses[misses++] = k;
+  }
+  NN_forward_batch(ctx->nn, vec->next_inputs, vec->next_qs, misses);
+  for (int m = 0; m < misses; m++)
+    memcpy(&vec->qs[vec->misses[m] * qcount], &vec->next_qs[m * qcount], sizeof(double) * qcount);
+}
+
+static void swap_rows(double **a, double **b) {
+  double *swap = *a;
+  *a = *b;
+  *b = swap;
+}
+
+void RL_step_vec(RL_agent_t agent, RL_agent_state_t *states, int count, RL_act_batch_cb act_batch) {
+  RL_ctx_t *ctx = agent;
+  if (!ctx->inited || !ctx->nn || ctx->actors || count <= 0)
+    return;
+  ctx->cached = RL_false;
+  vec_reserve(ctx, count);
+  RL_vec_t *vec = &ctx->vec;
+  int width = ctx->nn->input_size;
+  int qcount = ctx->qcount;
+
+  // one batched pass picks every environment's action, rows the last step already valued need none
+  vec_gather(ctx, states, count, vec->inputs);
+  vec_qvalues(ctx, count);
+  for (int k = 0; k < count; k++) {
+    vec->actions[k] = e_greedy_qs(ctx, &vec->qs[k * qcount], RL_nullptr);
+    vec->taken[k] = vec->actions[k].taken;
+  }
+  if (act_batch)
+    act_batch(states, vec->taken, count);
+  else {
+    for (int k = 0; k < count; k++)
+      ctx->act(states[k], vec->taken[k]);
+  }
+  for (int k = 0; k < count; k++)
+    vec->rewards[k] = ctx->reward(states[k]);
+
+  vec_gather(ctx, states, count, vec->next_inputs);
+  if (ctx->replay) {
+    for (int k = 0; k < count; k++)
+      replay_push(ctx->replay, &vec->inputs[k * width], vec->taken[k], vec->rewards[k], &vec->next_inputs[k * width]);
+    vec->cached = 0;
+    RL_learn(ctx);
+    return;
+  }
+
+  // the step's transitions form one mini-batch; the action values may be one update stale, so the update starts
+  // from a fresh pass over the rows rather than from them. The rewards become td targets
+  const double *select = bootstrap_qs(ctx, vec->next_inputs, vec->next_qs, vec->select_qs, count);
+  for (int k = 0; k < count; k++)
+    vec->rewards[k] = td_target(ctx, vec->rewards[k], vec->taken[k], &vec->next_qs[k * qcount], select ? &select[k * qcount] : RL_nullptr);
+  fit_batch(ctx, vec->inputs, vec->taken, vec->rewards, count);
+
+  // the bootstrap pass valued the next rows with the online network (a frozen target's values can't pick actions
+  // unless double Q-learning ran the online network too); they pick the next actions one update stale, as actors do
+  vec->cached = 0;
+  double **online = !ctx->target ? &vec->next_qs : select ? &vec->select_qs : RL_nullptr;
+  if (online) {
+    swap_rows(&vec->next_inputs, &vec->cache_inputs);
+    swap_rows(online, &vec->cache_qs);
+    vec->cached = count;
   }
+}
+
+RL_action_t RL_choose_action(RL_agent_t agent, const double *qs, RL_bool explore) {
+  RL_ctx_t *ctx = agent;
+  if (explore)
+    return e_greedy_qs(ctx, qs, RL_nullptr);
+  return (RL_action_t ) { q_argmax(qs, ctx->qcount), RL_false };
+}
+
+double RL_td_target(RL_agent_t agent, double reward, int action, const double *next_qs) {
+  return td_target(agent, reward, action, next_qs, RL_nullptr);
+}
+
+void RL_value_batch(RL_agent_t agent, const double *inputs, double *qs, int count) {
+  RL_ctx_t *ctx = agent;
+  if (ctx->nn && !ctx->actors)
+    NN_forward_batch(ctx->nn, inputs, qs, count);
+}
+
+void RL_fit_batch(RL_agent_t agent, const double *inputs, const int *actions, double *targets, int count) {
+  RL_ctx_t *ctx = agent;
+  if (ctx->nn && !ctx->actors && count > 0)
+    fit_batch(ctx, inputs, actions, targets, count);
+}
+
+static void actor_gather(RL_actor_t *actor, double *inputs) {
+  RL_ctx_t *ctx = actor->pool->ctx;
+  int width = ctx->nn->input_size;
+  for (int k = 0; k < actor->count; k++)
+    set_input(ctx, actor->actions[k], actor->states[k], &inputs[k * width]);
+}
+
+static void* actor_run(void *arg) {
+  RL_actor_t *actor = arg;
+  RL_actors_t *pool = actor->pool;
+  RL_ctx_t *ctx = pool->ctx;
+  int width = ctx->nn->input_size;
+  actor_gather(actor, actor->inputs);
+  while (atomic_load_explicit(&pool->running, memory_order_relaxed)) {
+    // stay at most one buffer ahead of the learner, cheap environments would otherwise only churn the ring
+    long lead = atomic_load_explicit(&pool->steps, memory_order_relaxed) - atomic_load_explicit(&pool->consumed, memory_order_relaxed);
+    if (lead > ctx->replay->capacity) {
+      atomic_fetch_add_explicit(&actor->quiescent, 1, memory_order_seq_cst);  // holds no snapshot while waiting
+      sched_yield();
+      continue;
+    }
+    // seq_cst with the publisher's exchange and reads: acquire / release would let this load see the old pointer
+    // while the publisher reads the count from before the bump that preceded it, and recycles the copy in use
+    const NN_neural_network_t *nn = atomic_load_explicit(&pool->snapshot, memory_order_seq_cst);
+    NN_forward_batch(nn, actor->inputs, actor->qs, actor->count);
+    atomic_fetch_add_explicit(&actor->quiescent, 1, memory_order_seq_cst);  // done with the snapshot
 
+    for (int k = 0; k < actor->count; k++) {
+      actor->actions[k] = e_greedy_qs(ctx, &actor->qs[k * ctx->qcount], &actor->rand);
+      ctx->act(actor->states[k], actor->actions[k].taken);
+    }
+    actor_gather(actor, actor->next_inputs);
+    for (int k = 0; k < actor->count; k++)
+      replay_push(ctx->replay, &actor->inputs[k * width], actor->actions[k].taken, ctx->reward(actor->states[k]), &actor->next_inputs[k * width]);
+    double *swap = actor->inputs;
+    actor->inputs = actor->next_inputs;
+    actor->next_inputs = swap;
+    atomic_fetch_add_explicit(&pool->steps, actor->count, memory_order_relaxed);
+  }
+  return RL_nullptr;
+}
+
+// RCU style: swap the pointer, wait out every actor's current read, then recycle the old copy
+static void actors_publish(RL_actors_t *pool) {
+  NN_copy_weights(pool->spare, pool->ctx->nn);
+  NN_neural_network_t *old = atomic_exchange_explicit(&pool->snapshot, pool->spare, memory_order_seq_cst);
+  for (int i = 0; i < pool->count; i++) {
+    RL_actor_t *actor = &pool->actors[i];
+    unsigned long seen = atomic_load_explicit(&actor->quiescent, memory_order_seq_cst);
+    while (atomic_load_explicit(&pool->running, memory_order_relaxed) && atomic_load_explicit(&actor->quiescent, memory_order_seq_cst) == seen)
+      sched_yield();
+  }
+  pool->spare = old;
+}
+
+static void* learner_run(void *arg) {
+  RL_actors_t *pool = arg;
+  int updates = 0;
+  while (atomic_load_explicit(&pool->running, memory_order_relaxed)) {
+    int count = RL_learn(pool->ctx);
+    if (!count) {
+      sched_yield();  // waiting for the replay buffer to fill
+      continue;
+    }
+    atomic_fetch_add_explicit(&pool->consumed, count, memory_order_relaxed);
+    if (++updates >= pool->publish_interval) {
+      actors_publish(pool);
+      updates = 0;
+    }
+  }
+  return RL_nullptr;
+}
+
+static NN_neural_network_t* snapshot_init(const NN_neural_network_t *nn) {
+  NN_neural_network_t *copy = malloc(sizeof(NN_neural_network_t));
+  NN_init_neural_network(copy, &nn->info);
+  NN_copy_weights(copy, nn);
+  return copy;
+}
+
+// the threads must have been joined
+static void actors_free(RL_ctx_t *ctx) {
+  RL_actors_t *pool = ctx->actors;
+  for (int i = 0; i < pool->count; i++) {
+    RL_actor_t *actor = &pool->actors[i];
+    free(actor->actions);
+    free(actor->inputs);
+    free(actor->next_inputs);
+    free(actor->qs);
+  }
+  free(atomic_load(&pool->snapshot));
+  free(pool->spare);
+  free(pool->actors);
+  free(pool);
+  ctx->actors = RL_nullptr;
+}
+
+RL_bool RL_start_actors(RL_agent_t agent, RL_agent_state_t *states, int count, int num_actors, int publish_interval) {
+  RL_ctx_t *ctx = agent;
+  if (!ctx->inited || !ctx->nn || !ctx->replay || ctx->actors || count <= 0 || num_actors <= 0)
+    return RL_false;
+  if (num_actors > count)
+    num_actors = count;
+
+  RL_actors_t *pool = malloc(sizeof(RL_actors_t));
+  pool->ctx = ctx;
+  pool->count = num_actors;
+  pool->actors = malloc(sizeof(RL_actor_t) * num_actors);
+  pool->publish_interval = publish_interval < 1 ? 1 : publish_interval;
+  pool->spare = snapshot_init(ctx->nn);
+  atomic_init(&pool->snapshot, snapshot_init(ctx->nn));
+  atomic_init(&pool->running, 1);
+  atomic_init(&pool->steps, 0);
+  atomic_init(&pool->consumed, 0);
+
+  int width = ctx->nn->input_size;
+  for (int i = 0; i < num_actors; i++) {
+    RL_actor_t *actor = &pool->actors[i];
+    int begin = (int) ((long) count * i / num_actors);
+    int end = (int) ((long) count * (i + 1) / num_actors);
+    actor->pool = pool;
+    actor->states = &states[begin];
+    actor->count = end - begin;
+    actor->rand = NN_rng_stream(1 + i);  // fixed per actor, the draws don't depend on thread timing
+    atomic_init(&actor->quiescent, 0);
+    actor->actions = malloc(sizeof(RL_action_t) * actor->count);
+    for (int k = 0; k < actor->count; k++)
+      actor->actions[k] = (RL_action_t ) { 0, RL_true };
+    actor->inputs = malloc(sizeof(double) * actor->count * width);
+    actor->next_inputs = malloc(sizeof(double) * actor->count * width);
+    actor->qs = malloc(sizeof(double) * actor->count * ctx->qcount);
+  }
+  ctx->actors = pool;
+  int started = 0;
+  while (started < num_actors && 0 == pthread_create(&pool->actors[started].thread, RL_nullptr, actor_run, &pool->actors[started]))
+    started++;
+  if (started == num_actors && 0 == pthread_create(&pool->learner, RL_nullptr, learner_run, pool))
+    return RL_true;
+
+  // a thread failed to start, the agent goes back to acting on its own
+  atomic_store(&pool->running, 0);
+  for (int i = 0; i < started; i++)
+    pthread_join(pool->actors[i].thread, RL_nullptr);
+  actors_free(ctx);
+  return RL_false;
+}
+
+long RL_stop_actors(RL_agent_t agent) {
+  RL_ctx_t *ctx = agent;
+  RL_actors_t *pool = ctx->actors;
+  if (!pool)
+    return 0;
+  atomic_store(&pool->running, 0);
+  pthread_join(pool->learner, RL_nullptr);
+  for (int i = 0; i < pool->count; i++)
+    pthread_join(pool->actors[i].thread, RL_nullptr);
+  long steps = atomic_load(&pool->steps);
+  actors_free(ctx);
+  return steps;
+}
+
+long RL_actor_steps(RL_agent_t agent) {
+  RL_ctx_t *ctx = agent;
+  return ctx->actors ? atomic_load_explicit(&ctx->actors->steps, memory_order_relaxed) : 0;
+}
+
+void RL_play(RL_agent_t agent) {
+  RL_ctx_t *ctx = agent;
+  if (ctx->inited && ctx->table) {
+    table_step(ctx, RL_false);
+    return;
+  }
+  if (!ctx->inited || !ctx->nn || ctx->actors)
+    return;
+  ctx->cached = RL_false;
+  update_qvalues(ctx, CURR_QS);
+  ctx->action = (RL_action_t ) { q_argmax(ctx->qs[CURR_QS], ctx->qcount), RL_false };
+  ctx->act(ctx->agent, ctx->action.taken);
+}
+
+static void update_recurrent_qvalues(RL_ctx_t *ctx, int which) {
+  // target is filled in once the reward is known
+  RNN_forward_propagate(ctx->rnn, ctx->input, ctx->qs[which]);
   for (int i = 0; i < ctx->qcount; i++)
-    ctx->nn->target[i] = ctx->qs[CURR_QS][i];
-  ctx->nn->target[ctx->action.taken] += ctx->alpha * (target - ctx->qs[CURR_QS][ctx->action.taken]);
-  NN_backward_propagate(ctx->nn);
+    ctx->qs[which][i] = ctx->rnn->prediction[i];
+}
+
+void RL_step_recurrent(RL_agent_t agent) {
+  RL_ctx_t *ctx = agent;
+  if (!ctx->inited || !ctx->rnn)
+    return;
+  RNN_neural_network_t *rnn = ctx->rnn;
+
+  // the last step's peek ran this observation with the same weights unless the rows differ, keep its activations
+  set_input(ctx, ctx->action, ctx->agent, ctx->input);
+  int next = (rnn->t + 1) % RNN_MAX_DEPTH;
+  if (ctx->peeked && 0 == memcmp(ctx->input, rnn->input.values[next], sizeof(double) * rnn->info.input_size)) {
+    rnn->t++;
+    memcpy(ctx->qs[CURR_QS], ctx->qs[NEXT_QS], sizeof(double) * ctx->qcount);
+  } else
+    update_recurrent_qvalues(ctx, CURR_QS);
+  int now = rnn->t % RNN_MAX_DEPTH;
+
+  ctx->action = e_greedy(ctx);
+  ctx->act(ctx->agent, ctx->action.taken);
+  double reward = ctx->reward(ctx->agent);
+
+  // peek one step ahead, then rewind so the next step re-enters at t + 1
+  set_input(ctx, ctx->action, ctx->agent, ctx->input);
+  update_recurrent_qvalues(ctx, NEXT_QS);
+  rnn->t--;
+
+  double target = td_target(ctx, reward, ctx->action.taken, ctx->qs[NEXT_QS], RL_nullptr);
+  double *targets = rnn->target.values[now];
+  for (int i = 0; i < ctx->qcount; i++)
+    targets[i] = ctx->qs[CURR_QS][i];
+  targets[ctx->action.taken] += ctx->alpha * (target - ctx->qs[CURR_QS][ctx->action.taken]);
+
+  // an update changes the weights the peek ran with, the next step then runs its own pass
+  ctx->peeked = 0 != (rnn->t % rnn->info.bptt_stride);
+  if (!ctx->peeked)
+    RNN_backward_propagate(rnn, NULL);
 }
 
 void RL_term(RL_agent_t *agent_ptr) {
   RL_ctx_t *ctx = *agent_ptr;
+  RL_stop_actors(ctx);
   if (ctx->nn) {
     free(ctx->nn);
   }
+  if (ctx->rnn)
+    free(ctx->rnn);
+  if (ctx->replay)
+    replay_term(ctx->replay);
+  if (ctx->target)
+    free(ctx->target);
+  if (ctx->table) {
+    table_free(ctx->table);
+    free(ctx->table);
+  }
+  free(ctx->vec.actions);
+  free(ctx->vec.inputs);
+  free(ctx->vec.next_inputs);
+  free(ctx->vec.qs);
+  free(ctx->vec.next_qs);
+  free(ctx->vec.select_qs);
+  free(ctx->vec.rewards);
+  free(ctx->vec.taken);
+  free(ctx->vec.cache_inputs);
+  free(ctx->vec.cache_qs);
+  free(ctx->vec.misses);
 
   if (ctx->qs[0])
     free(ctx->qs[0]);
@@ -150,7 +1127,124 @@ void RL_term(RL_agent_t *agent_ptr) {
   *agent_ptr = RL_nullptr;
 }
 
+// one row per visited state: the key, the observation, then the action values
+static void table_export(RL_ctx_t *ctx, const char *filename) {
+  RL_table_t *table = ctx->table;
+  FILE *fp = fopen(filename, "w");
+  if (!fp)
+    return;
+  fprintf(fp, "TABLE %d %d %d\n", table->count, table->width, ctx->qcount);
+  for (int i = 0; i < table->capacity; i++) {
+    if (!table->used[i])
+      continue;
+    fprintf(fp, "%llu", table->keys[i]);
+    for (int k = 0; k < table->width; k++)
+      fprintf(fp, " %.17g", table->inputs[i * table->width + k]);
+    for (int k = 0; k < ctx->qcount; k++)
+      fprintf(fp, " %.17g", table->qs[i * ctx->qcount + k]);
+    fprintf(fp, "\n");
+  }
+  fclose(fp);
+}
+
+// all or nothing: the rows load into a new table that replaces the agent's only once the whole file has been read
+static RL_bool table_import(RL_ctx_t *ctx, const char *filename) {
+  FILE *fp = fopen(filename, "r");
+  if (!fp)
+    return RL_false;
+  int count, width, qcount;
+  if (3 != fscanf(fp, "TABLE %d %d %d", &count, &width, &qcount) || count < 0 || count > RL_TABLE_MAX_COUNT
+      || width != ctx->table->width || qcount != ctx->qcount) {
+    fclose(fp);
+    return RL_false;  // not a table, or one for a different environment
+  }
+  RL_table_t loaded;
+  int capacity = RL_TABLE_CAPACITY;
+  while (2 * (count + 2) > capacity)
+    capacity *= 2;
+  table_alloc(&loaded, capacity, width, qcount);
+  RL_bool ok = RL_true;
+  for (int i = 0; ok && i < count; i++) {
+    unsigned long long key;
+    int row = 0;
+    ok = 1 == fscanf(fp, "%llu", &key);
+    if (ok) {
+      row = table_find(&loaded, key);
+      ok = !loaded.used[row];  // a key twice
+    }
+    for (int k = 0; ok && k < width; k++)
+      ok = 1 == fscanf(fp, "%lg", &loaded.inputs[row * width + k]);
+    for (int k = 0; ok && k < qcount; k++)
+      ok = 1 == fscanf(fp, "%lg", &loaded.qs[row * qcount + k]);
+    if (ok) {
+      loaded.used[row] = 1;
+      loaded.keys[row] = key;
+      loaded.count++;
+    }
+  }
+  char extra;
+  if (ok && 1 == fscanf(fp, " %c", &extra))
+    ok = RL_false;  // more rows than the header counts
+  fclose(fp);
+  if (!ok) {
+    table_free(&loaded);
+    return RL_false;
+  }
+  table_free(ctx->table);
+  *ctx->table = loaded;
+  return RL_true;
+}
+
 void RL_export_neural_network(RL_agent_t agent, const char *filename) {
   RL_ctx_t *ctx = agent;
+  if (ctx->table) {
+    table_export(ctx, filename);
+    return;
+  }
+  if (ctx->rnn) {
+    RNN_export_neural_network(ctx->rnn, filename);
+    return;
+  }
+  if (!ctx->nn)
+    return;
   NN_export_neural_network(ctx->nn, filename);
 }
+
+static RL_bool recurrent_import(RL_ctx_t *ctx, const char *filename) {
+  RNN_neural_network_t *rnn = malloc(sizeof(RNN_neural_network_t));
+  if (!RNN_import_neural_network(rnn, filename) || rnn->info.input_size != ctx->rnn->info.input_size || rnn->info.output_size != ctx->rnn->info.output_size) {
+    free(rnn);  // unreadable, or trained for a different environment
+    return RL_false;
+  }
+  free(ctx->rnn);
+  ctx->rnn = rnn;
+  ctx->peeked = RL_false;
+  return RL_true;
+}
+
+RL_bool RL_import_neural_network(RL_agent_t agent, const char *filename) {
+  RL_ctx_t *ctx = agent;
+  if (ctx->table)
+    return table_import(ctx, filename);
+  if (ctx->rnn)
+    return recurrent_import(ctx, filename);
+  if (!ctx->nn || ctx->actors)
+    return RL_false;
+  NN_neural_network_t *nn = RL_nullptr;
+  NN_import_neural_network(&nn, filename);
+  if (!nn)
+    return RL_false;
+  if (nn->input_size != ctx->nn->input_size || nn->output_size != ctx->nn->output_size) {
+    free(nn);  // trained for a different environment
+    return RL_false;
+  }
+  free(ctx->nn);
+  ctx->nn = nn;
+  ctx->vec.cached = 0;  // valued by the replaced weights
+  ctx->cached = RL_false;
+  if (ctx->target) {
+    NN_init_neural_network(ctx->target, &nn->info);
+    NN_copy_weights(ctx->target, nn);
+  }
+  return RL_true;
+}
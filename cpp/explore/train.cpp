@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+#include "mysdl2.h"	//https://github.com/frabbani/mysdl2
+
+#include "game.h"
+
+// headless trainer: no window and no frame pacing, the explorer steps as fast as the cpu allows
+// usage: train [steps] [checkpoint every] [actor threads] [checkpoint file] [gym] [obs]
+// "gym" steps through the compile-time engine (gym.h); actor threads then count explorers stepped together
+// "obs" drops the previous action from the network inputs, the viewer needs Game::actionInputs to match
+// the SDL viewer (main.cpp) loads and plays the checkpoint
+
+Game g;
+
+int main(int argc, char *args[]) {
+  setbuf( stdout, NULL);
+
+  long steps = argc > 1 ? atol(args[1]) : 1000000;
+  long every = argc > 2 ? atol(args[2]) : 100000;
+  int actors = argc > 3 ? atoi(args[3]) : 0;
+  const char *checkpoint = argc > 4 ? args[4] : "nn.txt";
+  bool gym = false;
+  for (int i = 5; i < argc; i++) {
+    gym |= std::string(args[i]) == "gym";
+    if (std::string(args[i]) == "obs")
+      g.actionInputs = false;
+  }
+  if (every <= 0)
+    every = steps;
+
+  g.gym = gym;
+  g.checkpointFile = checkpoint;
+  if (gym) {
+    g.envCount = actors > 0 ? actors : 1;
+    actors = 0;
+  } else {
+    g.actorThreads = actors;
+    if (actors > 0)
+      g.envCount = 4 * actors;
+  }
+  g.init();
+
+  auto start = std::chrono::steady_clock::now();
+  auto report = [&](long done) {
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%ld steps, %.1f s, %.0f steps/s -> %s\n", done, secs, secs > 0.0 ? done / secs : 0.0, checkpoint);
+  };
+
+  if (actors > 0) {
+    long next = every;
+    for (;;) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      long done = g.actorSteps + RL_actor_steps(g.rl->ai);
+      if (done < next && done < steps)
+        continue;
+      bool last = done >= steps;
+      g.checkpoint(checkpoint, !last);  // the last one leaves the actors stopped
+      report(g.actorSteps);
+      if (last)
+        break;
+      next = (g.actorSteps / every + 1) * every;
+    }
+  } else {
+    for (long i = 1; i <= steps; i++) {
+      g.explore();
+      if (0 == i % every || i == steps) {
+        g.checkpoint(checkpoint);
+        report(i);
+      }
+    }
+  }
+  if (gym)
+    printf("%ld episodes\n", g.gymRL->episodes);
+  return 0;
+}
@@ -34,17 +34,6 @@ int genRand(int min, int max) {
   return int(genRandLong(&mtRand) % d) - min;
 }
 
-double genRandomNormal(double sigma, double mu = 0.0) {
-  // Box-Muller transform
-
-  double u1 = genRandom();
-  double u2 = genRandom();
-  double z0 = sqrt(-2.0 * log(u1)) * cos(2.0 * 3.14159265358979323846 * u2);
-
-  // Scale and shift
-  return mu + z0 * sigma;
-}
-
 constexpr int numClusters = 5;
 constexpr double learningRate = 0.3;
 
@@ -67,6 +56,7 @@ std::vector<Point> points;
 std::array<Vector2, numClusters> origins;
 std::array<Vector2, numClusters> centroids;
 std::array<std::vector<Vector2>, numClusters> clusters;
+std::vector<double> normals;  // reset()'s sampling buffer
 
 void reset() {
   drawType = 0;
@@ -79,10 +69,13 @@ void reset() {
   for (auto o : origins) {
     int numPoints = int(genRandom(200, 300));
     int sigma = genRandom(30, 60);
+    // the cluster's normal samples in one call, two per point
+    normals.resize(numPoints * 2);
+    genRandNormalFill(&mtRand, normals.data(), numPoints * 2);
     for (int i = 0; i < numPoints; i++) {
       Vector2 v;
-      v.x = o.x + genRandomNormal(sigma);
-      v.y = o.y + genRandomNormal(sigma);
+      v.x = o.x + normals[i * 2] * sigma;
+      v.y = o.y + normals[i * 2 + 1] * sigma;
       points.push_back(Point { v, -1 });
     }
 
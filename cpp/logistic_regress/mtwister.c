@@ -13,54 +13,83 @@
 #define TEMPERING_MASK_B  0x9d2c5680
 #define TEMPERING_MASK_C  0xefc60000
 
+#include <math.h>
+
 #include "mtwister.h"
 
-inline static void m_seedRand(MTRand* rand, unsigned long seed) {
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+inline static void m_seedRand(MTRand *rand, unsigned long seed) {
   /* set initial seeds to mt[STATE_VECTOR_LENGTH] using the generator
    * from Line 25 of Table 1 in: Donald Knuth, "The Art of Computer
    * Programming," Vol. 2 (2nd Ed.) pp.102.
    */
   rand->mt[0] = seed & 0xffffffff;
-  for(rand->index=1; rand->index<STATE_VECTOR_LENGTH; rand->index++) {
-    rand->mt[rand->index] = (6069 * rand->mt[rand->index-1]) & 0xffffffff;
+  for (rand->index = 1; rand->index < STATE_VECTOR_LENGTH; rand->index++) {
+    rand->mt[rand->index] = (6069 * rand->mt[rand->index - 1]) & 0xffffffff;
   }
 }
 
 /**
-* Creates a new random number generator from a given seed.
-*/
+ * Creates a new random number generator from a given seed.
+ */
 MTRand seedRand(unsigned long seed) {
   MTRand rand;
   m_seedRand(&rand, seed);
   return rand;
 }
 
-/**
- * Generates a pseudo-randomly generated long.
- */
-unsigned long genRandLong(MTRand* rand) {
-
-  unsigned long y;
-  static unsigned long mag[2] = {0x0, 0x9908b0df}; /* mag[x] = x * 0x9908b0df for x = 0,1 */
-  if(rand->index >= STATE_VECTOR_LENGTH || rand->index < 0) {
-    /* generate STATE_VECTOR_LENGTH words at a time */
-    int kk;
-    if(rand->index >= STATE_VECTOR_LENGTH+1 || rand->index < 0) {
-      m_seedRand(rand, 4357);
-    }
-    for(kk=0; kk<STATE_VECTOR_LENGTH-STATE_VECTOR_M; kk++) {
-      y = (rand->mt[kk] & UPPER_MASK) | (rand->mt[kk+1] & LOWER_MASK);
-      rand->mt[kk] = rand->mt[kk+STATE_VECTOR_M] ^ (y >> 1) ^ mag[y & 0x1];
-    }
-    for(; kk<STATE_VECTOR_LENGTH-1; kk++) {
-      y = (rand->mt[kk] & UPPER_MASK) | (rand->mt[kk+1] & LOWER_MASK);
-      rand->mt[kk] = rand->mt[kk+(STATE_VECTOR_M-STATE_VECTOR_LENGTH)] ^ (y >> 1) ^ mag[y & 0x1];
-    }
-    y = (rand->mt[STATE_VECTOR_LENGTH-1] & UPPER_MASK) | (rand->mt[0] & LOWER_MASK);
-    rand->mt[STATE_VECTOR_LENGTH-1] = rand->mt[STATE_VECTOR_M-1] ^ (y >> 1) ^ mag[y & 0x1];
-    rand->index = 0;
+inline static unsigned int m_twistWord(unsigned int a, unsigned int b, unsigned int m) {
+  unsigned int y = (a & UPPER_MASK) | (b & LOWER_MASK);
+  return m ^ (y >> 1) ^ (0x9908b0df & (0 - (y & 0x1)));  /* mag[y & 1] without the lookup */
+}
+
+#ifdef __SSE2__
+/* four words of the recurrence: mt[kk..kk+3] from mt[kk..kk+4] and mt[m..m+3] */
+inline static void m_twistWords4(unsigned int *mt, int kk, int m) {
+  __m128i a = _mm_loadu_si128((const __m128i*) &mt[kk]);
+  __m128i b = _mm_loadu_si128((const __m128i*) &mt[kk + 1]);
+  __m128i c = _mm_loadu_si128((const __m128i*) &mt[m]);
+  __m128i y = _mm_or_si128(_mm_and_si128(a, _mm_set1_epi32((int) UPPER_MASK)), _mm_and_si128(b, _mm_set1_epi32(LOWER_MASK)));
+  __m128i odd = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(y, _mm_set1_epi32(1)));
+  __m128i mag = _mm_and_si128(odd, _mm_set1_epi32((int) 0x9908b0df));
+  _mm_storeu_si128((__m128i*) &mt[kk], _mm_xor_si128(_mm_xor_si128(c, _mm_srli_epi32(y, 1)), mag));
+}
+#endif
+
+/* generate STATE_VECTOR_LENGTH words at a time */
+static void m_twist(MTRand *rand) {
+  unsigned int *mt = rand->mt;
+  int kk = 0;
+  if (rand->index >= STATE_VECTOR_LENGTH + 1 || rand->index < 0) {
+    m_seedRand(rand, 4357);
+  }
+#ifdef __SSE2__
+  /* each word reads its successor before that one is rewritten, and mt[kk + M] either not yet
+   * rewritten (first part) or rewritten N - M words back (second part), so four lanes at once
+   * see exactly what the one word loop would */
+  for (; kk + 4 <= STATE_VECTOR_LENGTH - STATE_VECTOR_M; kk += 4) {
+    m_twistWords4(mt, kk, kk + STATE_VECTOR_M);
+  }
+#endif
+  for (; kk < STATE_VECTOR_LENGTH - STATE_VECTOR_M; kk++) {
+    mt[kk] = m_twistWord(mt[kk], mt[kk + 1], mt[kk + STATE_VECTOR_M]);
+  }
+#ifdef __SSE2__
+  for (; kk + 4 <= STATE_VECTOR_LENGTH - 1; kk += 4) {
+    m_twistWords4(mt, kk, kk + (STATE_VECTOR_M - STATE_VECTOR_LENGTH));
   }
-  y = rand->mt[rand->index++];
+#endif
+  for (; kk < STATE_VECTOR_LENGTH - 1; kk++) {
+    mt[kk] = m_twistWord(mt[kk], mt[kk + 1], mt[kk + (STATE_VECTOR_M - STATE_VECTOR_LENGTH)]);
+  }
+  mt[STATE_VECTOR_LENGTH - 1] = m_twistWord(mt[STATE_VECTOR_LENGTH - 1], mt[0], mt[STATE_VECTOR_M - 1]);
+  rand->index = 0;
+}
+
+inline static unsigned int m_temper(unsigned int y) {
   y ^= (y >> 11);
   y ^= (y << 7) & TEMPERING_MASK_B;
   y ^= (y << 15) & TEMPERING_MASK_C;
@@ -68,9 +97,173 @@ unsigned long genRandLong(MTRand* rand) {
   return y;
 }
 
+#ifdef __SSE2__
+inline static __m128i m_temper4(__m128i y) {
+  y = _mm_xor_si128(y, _mm_srli_epi32(y, 11));
+  y = _mm_xor_si128(y, _mm_and_si128(_mm_slli_epi32(y, 7), _mm_set1_epi32((int) TEMPERING_MASK_B)));
+  y = _mm_xor_si128(y, _mm_and_si128(_mm_slli_epi32(y, 15), _mm_set1_epi32((int) TEMPERING_MASK_C)));
+  return _mm_xor_si128(y, _mm_srli_epi32(y, 18));
+}
+#endif
+
+/* the next n tempered words, as n genRandLong calls would return them */
+static void m_fillWords(MTRand *rand, unsigned int *out, int n) {
+  while (n > 0) {
+    int i, count;
+    const unsigned int *mt;
+    if (rand->index >= STATE_VECTOR_LENGTH || rand->index < 0) {
+      m_twist(rand);
+    }
+    count = STATE_VECTOR_LENGTH - rand->index;
+    if (count > n) {
+      count = n;
+    }
+    mt = &rand->mt[rand->index];
+    i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= count; i += 4) {
+      _mm_storeu_si128((__m128i*) &out[i], m_temper4(_mm_loadu_si128((const __m128i*) &mt[i])));
+    }
+#endif
+    for (; i < count; i++) {
+      out[i] = m_temper(mt[i]);
+    }
+    rand->index += count;
+    out += count;
+    n -= count;
+  }
+}
+
+/**
+ * Generates a pseudo-randomly generated long.
+ */
+unsigned long genRandLong(MTRand *rand) {
+  if (rand->index >= STATE_VECTOR_LENGTH || rand->index < 0) {
+    m_twist(rand);
+  }
+  return m_temper(rand->mt[rand->index++]);
+}
+
 /**
  * Generates a pseudo-randomly generated double in the range [0..1].
  */
-double genRand(MTRand* rand) {
-  return (double)genRandLong(rand) / (double)0xffffffff;
+double genRand(MTRand *rand) {
+  return (double) genRandLong(rand) / (double) 0xffffffff;
+}
+
+/**
+ * Fills out with n doubles in the range [0..1], tempering and converting the state four words at a time.
+ */
+void genRandFill(MTRand *rand, double *out, int n) {
+  while (n > 0) {
+    int i, count;
+    const unsigned int *mt;
+    if (rand->index >= STATE_VECTOR_LENGTH || rand->index < 0) {
+      m_twist(rand);
+    }
+    count = STATE_VECTOR_LENGTH - rand->index;
+    if (count > n) {
+      count = n;
+    }
+    mt = &rand->mt[rand->index];
+    i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= count; i += 4) {
+      __m128i y = m_temper4(_mm_loadu_si128((const __m128i*) &mt[i]));
+      __m128d lo, hi;
+      /* SSE2 only converts signed words: flip the top bit and add it back as 2^31, both steps exact */
+      y = _mm_xor_si128(y, _mm_set1_epi32((int) UPPER_MASK));
+      lo = _mm_add_pd(_mm_cvtepi32_pd(y), _mm_set1_pd(2147483648.0));
+      hi = _mm_add_pd(_mm_cvtepi32_pd(_mm_srli_si128(y, 8)), _mm_set1_pd(2147483648.0));
+      _mm_storeu_pd(&out[i], _mm_div_pd(lo, _mm_set1_pd((double) 0xffffffff)));
+      _mm_storeu_pd(&out[i + 2], _mm_div_pd(hi, _mm_set1_pd((double) 0xffffffff)));
+    }
+#endif
+    for (; i < count; i++) {
+      out[i] = (double) m_temper(mt[i]) / (double) 0xffffffff;
+    }
+    rand->index += count;
+    out += count;
+    n -= count;
+  }
+}
+
+/* Ziggurat tables (Marsaglia & Tsang, "The Ziggurat Method for Generating Random Variables", 2000):
+ * 128 layers of equal area under the normal density, built on first use */
+#define ZIGGURAT_R 3.442619855899
+static unsigned int zig_k[128];  /* a word below zig_k[layer] lands inside the layer's box */
+static double zig_w[128];        /* word to x scale per layer */
+static double zig_f[128];        /* density at each layer's top edge */
+static int zig_ready = 0;
+
+static void m_zigSetup(void) {
+  const double m = 2147483648.0, v = 9.91256303526217e-3;
+  double d = ZIGGURAT_R, t = d, q = v / exp(-0.5 * d * d);
+  int i;
+  zig_k[0] = (unsigned int) ((d / q) * m);
+  zig_k[1] = 0;
+  zig_w[0] = q / m;
+  zig_w[127] = d / m;
+  zig_f[0] = 1.0;
+  zig_f[127] = exp(-0.5 * d * d);
+  for (i = 126; i >= 1; i--) {
+    d = sqrt(-2.0 * log(v / d + exp(-0.5 * d * d)));
+    zig_k[i + 1] = (unsigned int) ((d / t) * m);
+    t = d;
+    zig_f[i] = exp(-0.5 * d * d);
+    zig_w[i] = d / m;
+  }
+  zig_ready = 1;
+}
+
+/* (0..1) for the tail's logarithms, genRand can return either end */
+inline static double m_randOpen(MTRand *rand) {
+  return ((double) genRandLong(rand) + 0.5) / 4294967296.0;
+}
+
+/* the rare draw outside its layer's box: the wedge test, or the tail past ZIGGURAT_R for layer 0 */
+static double m_zigSlow(MTRand *rand, int hz) {
+  for (;;) {
+    int iz = hz & 127;
+    unsigned int mag = hz < 0 ? 0u - (unsigned int) hz : (unsigned int) hz;
+    double x = hz * zig_w[iz];
+    if (mag < zig_k[iz]) {
+      return x;
+    }
+    if (0 == iz) {
+      double y;
+      do {
+        x = -log(m_randOpen(rand)) / ZIGGURAT_R;
+        y = -log(m_randOpen(rand));
+      } while (y + y < x * x);
+      return hz > 0 ? ZIGGURAT_R + x : -ZIGGURAT_R - x;
+    }
+    if (zig_f[iz] + genRand(rand) * (zig_f[iz - 1] - zig_f[iz]) < exp(-0.5 * x * x)) {
+      return x;
+    }
+    hz = (int) genRandLong(rand);
+  }
+}
+
+/**
+ * Fills out with n standard normal samples. Words come off the state in blocks, about 99% of them
+ * become a sample with one compare and one multiply; the rest take extra draws.
+ */
+void genRandNormalFill(MTRand *rand, double *out, int n) {
+  unsigned int words[256];
+  if (!zig_ready) {
+    m_zigSetup();
+  }
+  while (n > 0) {
+    int i, count = n < 256 ? n : 256;
+    m_fillWords(rand, words, count);
+    for (i = 0; i < count; i++) {
+      int hz = (int) words[i];
+      int iz = hz & 127;
+      unsigned int mag = hz < 0 ? 0u - (unsigned int) hz : (unsigned int) hz;
+      out[i] = mag < zig_k[iz] ? hz * zig_w[iz] : m_zigSlow(rand, hz);
+    }
+    out += count;
+    n -= count;
+  }
 }
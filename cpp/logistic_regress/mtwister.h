@@ -1,18 +1,20 @@
 #ifndef __MTWISTER_H
 #define __MTWISTER_H
 
-
 #define STATE_VECTOR_LENGTH 624
 #define STATE_VECTOR_M      397 /* changes to STATE_VECTOR_LENGTH also require changes to this */
 
 typedef struct tagMTRand {
-  unsigned long mt[STATE_VECTOR_LENGTH];
+  unsigned int mt[STATE_VECTOR_LENGTH];  /* 32 bit words, four to an SSE2 register */
   int index;
 } MTRand;
 
-
 MTRand seedRand(unsigned long seed);
-unsigned long genRandLong(MTRand* rand);
-double genRand(MTRand* rand);
+unsigned long genRandLong(MTRand *rand);
+double genRand(MTRand *rand);
+/* n values of genRand in one call, the same sequence as n genRand calls */
+void genRandFill(MTRand *rand, double *out, int n);
+/* n standard normal samples (Ziggurat), for bulk dataset generation */
+void genRandNormalFill(MTRand *rand, double *out, int n);
 
 #endif /* #ifndef __MTWISTER_H */